@@ -0,0 +1,47 @@
+// Compares bounds-checked and unchecked element access, which is selected
+// at build time with STL_UNCHECKED, so each variant is a separate target
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/access_checked && benchmark/build/access_unchecked
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+template<typename T>
+static void BM_Stl(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period);
+    stl::StlWorkspace<T> workspace;
+
+    for (auto _ : state) {
+        stl::Stl<T> res{series, period, {.seasonal_length = n * 10 + 1, .robust = true}, workspace};
+        benchmark::DoNotOptimize(res.seasonal().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template<typename T>
+static void BM_Detect(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period, 100.0);
+    anomaly_detection::Workspace<T> workspace;
+
+    for (auto _ : state) {
+        anomaly_detection::AnomalyDetection res{series, period, {}, workspace};
+        benchmark::DoNotOptimize(res.anomalies().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+BENCHMARK_TEMPLATE(BM_Stl, float)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Stl, double)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Detect, float)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Detect, double)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,63 @@
+// Checks that detection with a warmed-up workspace only allocates the
+// anomalies it returns
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// ctest --test-dir benchmark/build
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include "allocations.hpp"
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+namespace {
+
+// Returns whether detections after the first allocate at most the anomalies
+template<typename T>
+bool check(size_t n, size_t period, const anomaly_detection::AnomalyDetectionParams& params) {
+    std::vector<T> series = generate_series<T>(n, period);
+    anomaly_detection::Workspace<T> workspace;
+
+    // warm up the workspace and the critical value cache
+    anomaly_detection::AnomalyDetection{series, period, params, workspace};
+
+    for (size_t i = 0; i < 3; i++) {
+        size_t before = allocations::count.load();
+        anomaly_detection::AnomalyDetection res{series, period, params, workspace};
+        size_t count = allocations::count.load() - before;
+
+        if (count > (res.anomalies().empty() ? 0 : 1)) {
+            std::cerr << "detection with a workspace allocated " << count << " times for "
+                << (sizeof(T) == 4 ? "float" : "double") << " n=" << n << " period=" << period << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+bool check_all() {
+    bool ok = true;
+    for (size_t n : {100, 1000, 10000}) {
+        for (size_t period : {1, 7, 24}) {
+            ok = check<T>(n, period, {}) && ok;
+            ok = check<T>(n, period, {.direction = anomaly_detection::Direction::Positive, .stats = true}) && ok;
+            ok = check<T>(n, period, {.robustness_tolerance = 0.01f, .interpolate = true}) && ok;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    bool ok = check_all<float>();
+    ok = check_all<double>() && ok;
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "workspace does not allocate" << std::endl;
+    return 0;
+}
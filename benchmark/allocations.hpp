@@ -0,0 +1,143 @@
+// Replaces the global allocation functions to count allocations and track
+// live and peak bytes. Every form (array, aligned, and nothrow) is replaced,
+// so no allocation bypasses the counts. Include in a single translation unit
+// of an executable.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace allocations {
+
+inline std::atomic<size_t> count{0};
+inline std::atomic<size_t> live{0};
+inline std::atomic<size_t> peak{0};
+
+namespace detail {
+
+// The size and offset of each allocation are stored before the pointer,
+// which keeps the requested alignment. These are not inlined into callers,
+// so the compiler does not match the malloc and free within them to new and delete.
+[[gnu::noinline]] inline void* allocate(size_t size, size_t alignment) noexcept {
+    size_t offset = std::max(alignment, alignof(std::max_align_t));
+    size_t total = (offset + size + offset - 1) / offset * offset;
+    auto start = static_cast<char*>(std::aligned_alloc(offset, total));
+    if (start == nullptr) {
+        return nullptr;
+    }
+
+    char* ptr = start + offset;
+    reinterpret_cast<size_t*>(ptr)[-2] = size;
+    reinterpret_cast<size_t*>(ptr)[-1] = offset;
+
+    count++;
+    size_t current = live += size;
+    size_t prev = peak.load();
+    while (current > prev && !peak.compare_exchange_weak(prev, current)) {}
+    return ptr;
+}
+
+[[gnu::noinline]] inline void deallocate(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    live -= static_cast<size_t*>(ptr)[-2];
+    std::free(static_cast<char*>(ptr) - static_cast<size_t*>(ptr)[-1]);
+}
+
+inline void* allocate_or_throw(size_t size, size_t alignment) {
+    void* ptr = allocate(size, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+} // namespace detail
+
+} // namespace allocations
+
+void* operator new(size_t size) {
+    return allocations::detail::allocate_or_throw(size, 1);
+}
+
+void* operator new[](size_t size) {
+    return allocations::detail::allocate_or_throw(size, 1);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocations::detail::allocate(size, 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocations::detail::allocate(size, 1);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocations::detail::allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocations::detail::allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocations::detail::allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocations::detail::allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    allocations::detail::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    allocations::detail::deallocate(ptr);
+}
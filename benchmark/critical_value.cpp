@@ -0,0 +1,58 @@
+// Compares computing the critical values of the ESD test with the cache,
+// and checks that the cache returns the same values
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/critical_value
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "anomaly_detection.hpp"
+
+using anomaly_detection::detail::CriticalValueCache;
+using anomaly_detection::detail::critical_value;
+
+static void BM_Compute(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t count = n / 10;
+
+    for (auto _ : state) {
+        std::vector<double> values;
+        values.reserve(count);
+        for (size_t i = 1; i <= count; i++) {
+            values.push_back(critical_value(n, i, 0.05f, false));
+        }
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+static void BM_Cache(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t count = n / 10;
+    CriticalValueCache cache;
+
+    for (float alpha : {0.05f, 0.001f}) {
+        for (bool one_tail : {false, true}) {
+            std::vector<double> values = cache.get(n, count, alpha, one_tail);
+            for (size_t i = 1; i <= count; i++) {
+                if (values.at(i - 1) != critical_value(n, i, alpha, one_tail)) {
+                    state.SkipWithError("cached value does not match");
+                    return;
+                }
+            }
+        }
+    }
+
+    for (auto _ : state) {
+        std::vector<double> values = cache.get(n, count, 0.05f, false);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+BENCHMARK(BM_Compute)->RangeMultiplier(10)->Range(100, 100000);
+BENCHMARK(BM_Cache)->RangeMultiplier(10)->Range(100, 100000);
@@ -0,0 +1,35 @@
+// Compares the throughput and memory of the float and double instantiations
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/dtype
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocations.hpp"
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+template<typename T>
+static void BM_Detect(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period, 1e6);
+
+    size_t bytes = 0;
+    for (auto _ : state) {
+        size_t before = allocations::live.load();
+        allocations::peak = before;
+        anomaly_detection::AnomalyDetection res{series, period};
+        benchmark::DoNotOptimize(res.anomalies().data());
+        bytes = allocations::peak.load() - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["peak_bytes"] = static_cast<double>(bytes);
+}
+
+BENCHMARK_TEMPLATE(BM_Detect, float)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Detect, double)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,145 @@
+// Compares the ESD loop with a reference that recomputes the residuals and
+// sorts the deviations for the MAD each iteration (like the R package),
+// and checks that both find the same anomalies
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/esd
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+using anomaly_detection::AnomalyDetection;
+using anomaly_detection::Decomposition;
+using anomaly_detection::Direction;
+
+namespace {
+
+template<typename T>
+T median_sorted(const std::vector<T>& sorted) {
+    return (sorted.at((sorted.size() - 1) / 2) + sorted.at(sorted.size() / 2)) / static_cast<T>(2.0);
+}
+
+template<typename T>
+std::vector<size_t> reference_esd(std::vector<T> data2, std::vector<size_t> indexes, float k, float alpha, Direction direction) {
+    bool one_tail = direction != Direction::Both;
+    bool upper_tail = direction == Direction::Positive;
+    size_t n = data2.size();
+    size_t num_anoms = 0;
+    auto max_outliers = static_cast<size_t>(static_cast<float>(n) * k);
+    std::vector<size_t> anomalies;
+
+    for (size_t i = 1; i <= max_outliers; i++) {
+        T ma = median_sorted(data2);
+        std::vector<T> ares;
+        ares.reserve(data2.size());
+        for (auto v : data2) {
+            if (one_tail) {
+                ares.push_back(upper_tail ? v - ma : ma - v);
+            } else {
+                ares.push_back(std::abs(v - ma));
+            }
+        }
+
+        std::vector<T> deviations;
+        deviations.reserve(data2.size());
+        for (auto v : data2) {
+            deviations.push_back(std::abs(v - ma));
+        }
+        std::ranges::sort(deviations);
+        T data_sigma = static_cast<T>(1.4826) * median_sorted(deviations);
+        if (data_sigma == 0.0) {
+            break;
+        }
+
+        auto r_idx_i = static_cast<size_t>(std::distance(ares.begin(), std::ranges::max_element(ares)));
+        T r = ares.at(r_idx_i) / data_sigma;
+        anomalies.push_back(indexes.at(r_idx_i));
+        data2.erase(data2.begin() + static_cast<ptrdiff_t>(r_idx_i));
+        indexes.erase(indexes.begin() + static_cast<ptrdiff_t>(r_idx_i));
+
+        if (r > anomaly_detection::detail::critical_value(n, i, alpha, one_tail)) {
+            num_anoms = i;
+        }
+    }
+
+    anomalies.resize(num_anoms);
+    std::ranges::sort(anomalies);
+    return anomalies;
+}
+
+} // namespace
+
+static void BM_Reference(benchmark::State& state, Direction direction) {
+    auto n = static_cast<size_t>(state.range(0));
+    Decomposition<float> decomposition{generate_series<float>(n, 24), 24};
+
+    for (auto _ : state) {
+        std::vector<size_t> anomalies = reference_esd(decomposition.residuals(), decomposition.indexes(), 0.1f, 0.05f, direction);
+        benchmark::DoNotOptimize(anomalies.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+static void BM_Esd(benchmark::State& state, Direction direction) {
+    auto n = static_cast<size_t>(state.range(0));
+    Decomposition<float> decomposition{generate_series<float>(n, 24), 24};
+
+    if (n <= 10000) {
+        std::vector<size_t> expected = reference_esd(decomposition.residuals(), decomposition.indexes(), 0.1f, 0.05f, direction);
+        if (AnomalyDetection{decomposition, {.direction = direction}}.anomalies() != expected) {
+            state.SkipWithError("anomalies do not match the reference");
+            return;
+        }
+    }
+
+    for (auto _ : state) {
+        AnomalyDetection res{decomposition, {.direction = direction}};
+        benchmark::DoNotOptimize(res.anomalies().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+// clips the highest 30% of values like a saturated metric,
+// so the highest residual has many ties
+static void BM_EsdClipped(benchmark::State& state, Direction direction) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<float> series = generate_series<float>(n, 24);
+    std::vector<float> sorted = series;
+    std::ranges::sort(sorted);
+    float max = sorted.at(n * 7 / 10);
+    for (auto& v : series) {
+        v = std::min(v, max);
+    }
+    Decomposition<float> decomposition{series, 1};
+
+    if (n <= 10000) {
+        std::vector<size_t> expected = reference_esd(decomposition.residuals(), decomposition.indexes(), 0.1f, 0.05f, direction);
+        if (AnomalyDetection{decomposition, {.direction = direction}}.anomalies() != expected) {
+            state.SkipWithError("anomalies do not match the reference");
+            return;
+        }
+    }
+
+    for (auto _ : state) {
+        AnomalyDetection res{decomposition, {.direction = direction}};
+        benchmark::DoNotOptimize(res.anomalies().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+BENCHMARK_CAPTURE(BM_Reference, both, Direction::Both)->RangeMultiplier(10)->Range(1000, 10000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Esd, both, Direction::Both)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Reference, pos, Direction::Positive)->RangeMultiplier(10)->Range(1000, 10000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Esd, pos, Direction::Positive)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Reference, neg, Direction::Negative)->RangeMultiplier(10)->Range(1000, 10000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Esd, neg, Direction::Negative)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_EsdClipped, pos, Direction::Positive)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_EsdClipped, both, Direction::Both)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,61 @@
+// Compares the loess kernel of STL for each instruction set
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/loess
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "stl.hpp"
+#include "series.hpp"
+
+using stl::detail::Isa;
+
+template<typename T, Isa isa>
+static void BM_Est(benchmark::State& state) {
+    if (isa > stl::detail::est_isa()) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+
+    auto len = static_cast<size_t>(state.range(0));
+    size_t n = 10000;
+    std::vector<T> y = generate_series<T>(n, 24);
+    std::vector<T> rw(n, static_cast<T>(1.0));
+    size_t half = len / 2;
+
+    for (auto _ : state) {
+        for (size_t i = half + 1; i <= n - half; i++) {
+            auto xs = static_cast<T>(i);
+            T h = stl::detail::bandwidth(n, len, xs, i - half, i + half);
+            auto s = stl::detail::est_sums<T, false, true>(isa, y.data(), rw.data(), nullptr, i - half, i + half, xs, h);
+            benchmark::DoNotOptimize(s);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>((n - 2 * half) * len));
+}
+
+template<typename T>
+static void BM_Stl(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period);
+
+    for (auto _ : state) {
+        stl::Stl<T> res{series, period, {.seasonal_length = n * 10 + 1, .robust = true}};
+        benchmark::DoNotOptimize(res.seasonal().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+BENCHMARK_TEMPLATE(BM_Est, float, Isa::Scalar)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Est, float, Isa::Avx2)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Est, float, Isa::Avx512)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Est, double, Isa::Scalar)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Est, double, Isa::Avx2)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Est, double, Isa::Avx512)->Arg(9)->Arg(37)->Arg(401);
+BENCHMARK_TEMPLATE(BM_Stl, float)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Stl, double)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,61 @@
+// Compares detection with a single period and with daily and weekly
+// periods (MSTL) on minute data with both seasonalities
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/mstl
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "anomaly_detection.hpp"
+
+namespace {
+
+constexpr size_t day = 1440;
+constexpr size_t week = day * 7;
+
+// Generates minute data with daily and weekly seasonality, noise, and a few spikes
+std::vector<float> generate_minutes(size_t n) {
+    std::mt19937 rng{42};
+    std::normal_distribution<double> noise{0.0, 1.0};
+    std::vector<float> series;
+    series.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        double v = 10.0 * std::sin(2.0 * M_PI * static_cast<double>(i % day) / static_cast<double>(day));
+        v += 10.0 * std::sin(2.0 * M_PI * static_cast<double>(i % week) / static_cast<double>(week));
+        v += noise(rng);
+        if (rng() % 1000 == 0) {
+            v += 25.0;
+        }
+        series.push_back(static_cast<float>(v));
+    }
+    return series;
+}
+
+} // namespace
+
+static void BM_Detect(benchmark::State& state, std::vector<size_t> periods) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto threads = static_cast<size_t>(state.range(1));
+    std::vector<float> series = generate_minutes(n);
+
+    size_t count = 0;
+    for (auto _ : state) {
+        anomaly_detection::AnomalyDetection res{series, periods, {.max_anoms = 0.02f, .threads = threads}};
+        count = res.anomalies().size();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["anomalies"] = static_cast<double>(count);
+}
+
+BENCHMARK_CAPTURE(BM_Detect, daily, std::vector<size_t>{day})
+    ->ArgsProduct({{static_cast<int64_t>(week * 8)}, {1, 4}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Detect, daily_weekly, std::vector<size_t>{day, week})
+    ->ArgsProduct({{static_cast<int64_t>(week * 8)}, {1, 4}})
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// Generates a seasonal series with noise and a few spikes
+template<typename T>
+std::vector<T> generate_series(size_t n, size_t period, double offset = 0.0) {
+    std::mt19937 rng{42};
+    std::normal_distribution<double> noise{0.0, 1.0};
+    std::vector<T> series;
+    series.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        double v = offset + 10.0 * std::sin(2.0 * M_PI * static_cast<double>(i % period) / static_cast<double>(period));
+        v += noise(rng);
+        if (rng() % 100 == 0) {
+            v += 25.0;
+        }
+        series.push_back(static_cast<T>(v));
+    }
+    return series;
+}
@@ -0,0 +1,126 @@
+// Compares ordering the residuals with a radix sort and with comparison
+// sorts that break ties by index, checks that they give the same order, and
+// reports the peak bytes of scratch space each allocates
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/sort
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocations.hpp"
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+using anomaly_detection::detail::RadixItem;
+using anomaly_detection::detail::radix_sort_indexes;
+
+namespace {
+
+template<typename T>
+void comparison_sort_indexes(const std::vector<T>& values, std::vector<size_t>& indexes) {
+    indexes.resize(values.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::ranges::sort(indexes, [&values](size_t a, size_t b) {
+        return values[a] < values[b] || (values[a] == values[b] && a < b);
+    });
+}
+
+// Returns the peak bytes allocated by a function beyond what was live before
+template<typename F>
+size_t peak_bytes(F&& func) {
+    size_t live = allocations::live.load();
+    allocations::peak = live;
+    func();
+    return allocations::peak.load() - live;
+}
+
+// rounds values to create ties
+template<typename T>
+std::vector<T> generate_values(size_t n) {
+    std::vector<T> values = generate_series<T>(n, 24);
+    for (auto& v : values) {
+        v = static_cast<T>(static_cast<int64_t>(v * 100.0)) / static_cast<T>(100.0);
+    }
+    return values;
+}
+
+} // namespace
+
+template<typename T>
+static void BM_Comparison(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<T> values = generate_values<T>(n);
+    std::vector<size_t> indexes;
+
+    indexes.resize(n);
+    size_t peak = peak_bytes([&] { comparison_sort_indexes(values, indexes); });
+
+    for (auto _ : state) {
+        comparison_sort_indexes(values, indexes);
+        benchmark::DoNotOptimize(indexes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["peak_bytes"] = static_cast<double>(peak);
+}
+
+// the sort before the radix sort, which allocates a merge buffer
+template<typename T>
+static void BM_StableSort(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<T> values = generate_values<T>(n);
+    std::vector<size_t> indexes(n);
+    auto sort = [&] {
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::ranges::stable_sort(indexes, [&values](size_t a, size_t b) {
+            return values[a] < values[b];
+        });
+    };
+    size_t peak = peak_bytes(sort);
+
+    for (auto _ : state) {
+        sort();
+        benchmark::DoNotOptimize(indexes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["peak_bytes"] = static_cast<double>(peak);
+}
+
+template<typename T>
+static void BM_Radix(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<T> values = generate_values<T>(n);
+    std::vector<size_t> indexes;
+    std::vector<RadixItem<T>> items;
+    std::vector<RadixItem<T>> items2;
+
+    std::vector<size_t> expected;
+    comparison_sort_indexes(values, expected);
+    indexes.resize(n);
+    std::iota(indexes.begin(), indexes.end(), 0);
+    size_t peak = peak_bytes([&] { radix_sort_indexes(values, indexes, items, items2); });
+    if (indexes != expected) {
+        state.SkipWithError("order does not match");
+        return;
+    }
+
+    for (auto _ : state) {
+        std::iota(indexes.begin(), indexes.end(), 0);
+        radix_sort_indexes(values, indexes, items, items2);
+        benchmark::DoNotOptimize(indexes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["peak_bytes"] = static_cast<double>(peak);
+}
+
+BENCHMARK_TEMPLATE(BM_Comparison, float)->RangeMultiplier(10)->Range(10, 10000000);
+BENCHMARK_TEMPLATE(BM_StableSort, float)->RangeMultiplier(10)->Range(10, 10000000);
+BENCHMARK_TEMPLATE(BM_Radix, float)->RangeMultiplier(10)->Range(10, 10000000);
+BENCHMARK_TEMPLATE(BM_Comparison, double)->RangeMultiplier(10)->Range(10, 10000000);
+BENCHMARK_TEMPLATE(BM_StableSort, double)->RangeMultiplier(10)->Range(10, 10000000);
+BENCHMARK_TEMPLATE(BM_Radix, double)->RangeMultiplier(10)->Range(10, 10000000);
@@ -0,0 +1,118 @@
+// Tracks the performance of detection, decomposition, and critical values
+// across series lengths, periods, max_anoms, directions, and dtypes
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/suite --benchmark_out=suite.json --benchmark_out_format=json
+//
+// or cmake --build benchmark/build --target suite_json to write benchmark/build/suite.json
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "anomaly_detection.hpp"
+#include "dist.h"
+#include "series.hpp"
+
+using anomaly_detection::Direction;
+
+namespace {
+
+constexpr std::array<Direction, 3> directions{Direction::Positive, Direction::Negative, Direction::Both};
+
+const std::vector<int64_t> lengths{1000, 10000, 100000, 1000000, 10000000};
+const std::vector<int64_t> periods{7, 24, 168, 1440};
+
+} // namespace
+
+// max_anoms is in percent
+template<typename T>
+static void BM_Detect(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto period = static_cast<size_t>(state.range(1));
+    std::vector<T> series = generate_series<T>(n, period, 100.0);
+    anomaly_detection::AnomalyDetectionParams params{
+        .max_anoms = static_cast<float>(state.range(2)) / 100.0f,
+        .direction = directions.at(static_cast<size_t>(state.range(3)))
+    };
+
+    size_t count = 0;
+    for (auto _ : state) {
+        anomaly_detection::AnomalyDetection res{series, period, params};
+        benchmark::DoNotOptimize(res.anomalies().data());
+        count = res.anomalies().size();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["anomalies"] = static_cast<double>(count);
+}
+
+// robust is 0 for none, 1 for 15 iterations, and 2 for a tolerance of 0.01
+template<typename T>
+static void BM_Stl(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto period = static_cast<size_t>(state.range(1));
+    std::vector<T> series = generate_series<T>(n, period);
+    stl::StlParams params{.seasonal_length = n * 10 + 1, .robust = state.range(2) != 0};
+    if (state.range(2) == 2) {
+        params.tolerance = 0.01f;
+    }
+
+    for (auto _ : state) {
+        stl::Stl<T> res{series, period, params};
+        benchmark::DoNotOptimize(res.seasonal().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+template<typename T>
+static void BM_Mstl(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<size_t> mstl_periods{24, 168};
+    std::vector<T> series = generate_series<T>(n, 24);
+    stl::MstlParams params{.stl_params = {.robust = state.range(1) != 0}};
+
+    for (auto _ : state) {
+        stl::Mstl<T> res{series, mstl_periods, params};
+        benchmark::DoNotOptimize(res.remainder().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+
+// df is the degrees of freedom, with the probabilities of the ESD tests
+static void BM_StudentsTPpf(benchmark::State& state) {
+    auto df = static_cast<double>(state.range(0));
+    std::vector<double> ps;
+    for (size_t i = 1; i <= 100; i++) {
+        ps.push_back(1.0 - 0.05 / (2.0 * static_cast<double>(i)));
+    }
+
+    for (auto _ : state) {
+        for (auto p : ps) {
+            benchmark::DoNotOptimize(students_t_ppf(p, df));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ps.size()));
+}
+
+static void detect_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"n", "period", "max_anoms", "direction"});
+    b->ArgsProduct({lengths, {24}, {10}, {2}});
+    b->ArgsProduct({{100000}, periods, {1, 10, 49}, {0, 1, 2}});
+}
+
+static void stl_args(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"n", "period", "robust"});
+    b->ArgsProduct({lengths, {24}, {0, 1, 2}});
+    b->ArgsProduct({{100000}, periods, {0, 1, 2}});
+}
+
+BENCHMARK_TEMPLATE(BM_Detect, float)->Apply(detect_args)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Detect, double)->Apply(detect_args)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Stl, float)->Apply(stl_args)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Stl, double)->Apply(stl_args)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Mstl, float)->ArgNames({"n", "robust"})->ArgsProduct({{1000, 10000, 100000, 1000000}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Mstl, double)->ArgNames({"n", "robust"})->ArgsProduct({{1000, 10000, 100000, 1000000}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StudentsTPpf)->ArgName("df")->Arg(1)->Arg(2)->Arg(10)->Arg(1000)->Arg(100000);
@@ -0,0 +1,56 @@
+// Compares detection with and without a reused workspace, and counts
+// allocations (allocation_check fails when a workspace allocates)
+//
+// cmake -S benchmark -B benchmark/build && cmake --build benchmark/build
+// benchmark/build/workspace
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocations.hpp"
+#include "anomaly_detection.hpp"
+#include "series.hpp"
+
+template<typename T>
+static void BM_Detect(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period);
+
+    size_t count = 0;
+    for (auto _ : state) {
+        size_t before = allocations::count.load();
+        anomaly_detection::AnomalyDetection res{series, period};
+        benchmark::DoNotOptimize(res.anomalies().data());
+        count = allocations::count.load() - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["allocations"] = static_cast<double>(count);
+}
+
+template<typename T>
+static void BM_DetectWorkspace(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    size_t period = 24;
+    std::vector<T> series = generate_series<T>(n, period);
+    anomaly_detection::Workspace<T> workspace;
+
+    // warm up the workspace and the critical value cache
+    anomaly_detection::AnomalyDetection{series, period, {}, workspace};
+
+    size_t count = 0;
+    for (auto _ : state) {
+        size_t before = allocations::count.load();
+        anomaly_detection::AnomalyDetection res{series, period, {}, workspace};
+        benchmark::DoNotOptimize(res.anomalies().data());
+        count = allocations::count.load() - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+    state.counters["allocations"] = static_cast<double>(count);
+}
+
+BENCHMARK_TEMPLATE(BM_Detect, float)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_DetectWorkspace, float)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond);
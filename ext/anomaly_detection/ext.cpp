@@ -1,15 +1,388 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <rice/rice.hpp>
+#include <rice/stl.hpp>
+#include <ruby/memory_view.h>
+#include <ruby/thread.h>
 
 #include "anomaly_detection.hpp"
 
+using anomaly_detection::AnomalyDetails;
 using anomaly_detection::AnomalyDetection;
 using anomaly_detection::AnomalyDetectionParams;
+using anomaly_detection::BatchAnomalyDetection;
+using anomaly_detection::Decomposition;
+using anomaly_detection::DecompositionParams;
+using anomaly_detection::DetectionStats;
 using anomaly_detection::Direction;
+using anomaly_detection::StreamingAnomalyDetection;
+using anomaly_detection::TimestampAnomalyDetection;
+
+namespace {
+
+// Runs a function without the GVL. The unblocking function sets the
+// cancelled flag, which detection polls between steps. Pending interrupts
+// are not handled here, since raising would skip the destructors of the
+// C++ frames above, so the function is skipped when one is pending.
+template<typename F>
+void call_without_gvl(F& func, std::atomic<bool>& cancelled) {
+  rb_nogvl(
+    [](void* data) -> void* {
+      (*static_cast<F*>(data))();
+      return nullptr;
+    },
+    &func,
+    [](void* data) {
+      static_cast<std::atomic<bool>*>(data)->store(true);
+    },
+    &cancelled,
+    RB_NOGVL_INTR_FAIL
+  );
+}
+
+// Runs detection or decomposition without the GVL, with the cancelled flag
+// of its params set
+template<typename P, typename F>
+auto detect_without_gvl(P params, F&& detect) {
+  using Result = std::invoke_result_t<F, const P&>;
+
+  while (true) {
+    std::atomic<bool> cancelled = false;
+    params.cancelled = &cancelled;
+
+    std::optional<Result> res;
+    std::exception_ptr error;
+    auto run = [&]() {
+      // exceptions cannot cross the C frames of rb_nogvl
+      try {
+        res.emplace(detect(params));
+      } catch (...) {
+        error = std::current_exception();
+      }
+    };
+    call_without_gvl(run, cancelled);
+
+    // raises if the thread was interrupted (Thread#kill, Timeout, etc)
+    // as a C++ exception, so destructors run
+    Rice::detail::protect(rb_thread_check_ints);
+
+    if (res.has_value()) {
+      return std::move(res.value());
+    }
+    if (error && !cancelled.load()) {
+      std::rethrow_exception(error);
+    }
+    // otherwise, the function was skipped for an interrupt that did not raise
+    // or stopped by a spurious wakeup, so start over
+  }
+}
+
+Direction parse_direction(Rice::String rb_direction) {
+  std::string direction = rb_direction.str();
+  if (direction == "pos") {
+    return Direction::Positive;
+  } else if (direction == "neg") {
+    return Direction::Negative;
+  } else if (direction == "both") {
+    return Direction::Both;
+  } else {
+    throw std::invalid_argument("direction must be pos, neg, or both");
+  }
+}
+
+enum class Dtype {
+  Float32,
+  Float64
+};
+
+Dtype parse_dtype(Rice::String rb_dtype) {
+  std::string dtype = rb_dtype.str();
+  if (dtype == "float32") {
+    return Dtype::Float32;
+  } else if (dtype == "float64") {
+    return Dtype::Float64;
+  } else {
+    throw std::invalid_argument("dtype must be float32 or float64");
+  }
+}
+
+template<typename T>
+Rice::Array to_ruby(const std::vector<T>& anomalies) {
+  Rice::Array a;
+  for (const auto v : anomalies) {
+    a.push(v, false);
+  }
+  return a;
+}
+
+// results besides the anomalies, which are returned in hashes and arrays
+struct Extras {
+  DetectionStats stats;
+  AnomalyDetails details;
+  std::vector<int64_t> imputed;
+};
+
+// Converts an array to values, with nil as NAN when missing values are filled.
+// Ruby calls that can raise are protected, so the vector is freed.
+template<typename T>
+std::vector<T> to_series(Rice::Array rb_series, bool interpolate) {
+  if (!interpolate) {
+    return rb_series.to_vector<T>();
+  }
+
+  std::vector<T> series;
+  series.reserve(static_cast<size_t>(rb_series.size()));
+  for (long i = 0; i < rb_series.size(); i++) {
+    VALUE v = rb_ary_entry(rb_series.value(), i);
+    series.push_back(NIL_P(v) ? std::numeric_limits<T>::quiet_NaN() : static_cast<T>(Rice::detail::protect(rb_num2dbl, v)));
+  }
+  return series;
+}
+
+// Sets an array to the imputed indexes or timestamps
+void set_imputed(Rice::Object rb_imputed, const std::vector<int64_t>& imputed) {
+  Rice::detail::protect(rb_ary_clear, rb_imputed.value());
+  Rice::Array a{rb_imputed.value()};
+  for (auto v : imputed) {
+    a.push(v, false);
+  }
+}
+
+Rice::String to_packed(const std::vector<double>& values) {
+  return Rice::String(rb_str_new(reinterpret_cast<const char*>(values.data()), static_cast<long>(values.size() * sizeof(double))));
+}
+
+// Sets the details in a hash as packed native doubles
+void set_details(Rice::Object rb_details, const AnomalyDetails& details) {
+  Rice::Hash h{rb_details};
+  h[Rice::Symbol("scores")] = to_packed(details.scores);
+  h[Rice::Symbol("critical_values")] = to_packed(details.critical_values);
+  h[Rice::Symbol("expected_values")] = to_packed(details.expected_values);
+  h[Rice::Symbol("residuals")] = to_packed(details.residuals);
+}
+
+// Sets the stats in a hash, with times in seconds
+void set_stats(Rice::Object rb_stats, const DetectionStats& stats) {
+  auto seconds = [](std::chrono::nanoseconds t) {
+    return std::chrono::duration<double>(t).count();
+  };
+
+  Rice::Hash h{rb_stats};
+  h[Rice::Symbol("median_time")] = seconds(stats.median_time);
+  h[Rice::Symbol("decompose_time")] = seconds(stats.decompose_time);
+  h[Rice::Symbol("sort_time")] = seconds(stats.sort_time);
+  h[Rice::Symbol("critical_values_time")] = seconds(stats.critical_values_time);
+  h[Rice::Symbol("esd_time")] = seconds(stats.esd_time);
+  h[Rice::Symbol("iterations")] = stats.iterations;
+  h[Rice::Symbol("outer_loops")] = stats.outer_loops;
+  h[Rice::Symbol("allocated_bytes")] = stats.allocated_bytes;
+}
+
+// Returns the params for detect and detect_timestamps, with stats and
+// details recorded when there is a hash to set them in
+AnomalyDetectionParams make_params(float k, float alpha, Rice::String rb_direction, bool verbose, size_t threads, size_t stop_after, std::optional<size_t> window_length, std::optional<float> robustness_tolerance, bool interpolate, Rice::Object rb_stats, Rice::Object rb_details) {
+  return AnomalyDetectionParams{
+    .alpha = alpha,
+    .max_anoms = k,
+    .direction = parse_direction(rb_direction),
+    .verbose = verbose,
+    .stop_after = stop_after,
+    .window_length = window_length,
+    .threads = threads,
+    .robustness_tolerance = robustness_tolerance,
+    .stats = !rb_stats.is_nil(),
+    .details = !rb_details.is_nil(),
+    .interpolate = interpolate
+  };
+}
+
+// Sets the extras in the hashes and array that were passed, if any
+void set_extras(Rice::Object rb_stats, Rice::Object rb_details, Rice::Object rb_imputed, const Extras& extras) {
+  if (!rb_stats.is_nil()) {
+    set_stats(rb_stats, extras.stats);
+  }
+  if (!rb_details.is_nil()) {
+    set_details(rb_details, extras.details);
+  }
+  if (!rb_imputed.is_nil()) {
+    set_imputed(rb_imputed, extras.imputed);
+  }
+}
+
+template<typename T>
+Rice::Array detect(std::span<const T> series, std::span<const size_t> periods, const AnomalyDetectionParams& params, Extras& extras) {
+  std::vector<size_t> anomalies = detect_without_gvl(params, [&](const AnomalyDetectionParams& p) {
+    AnomalyDetection res{series, periods, p};
+    extras.stats = res.stats();
+    extras.details = res.details();
+    extras.imputed.assign(res.imputed().begin(), res.imputed().end());
+    return res.anomalies();
+  });
+  return to_ruby(anomalies);
+}
+
+template<typename T>
+Rice::Array detect_array(Rice::Array rb_series, std::span<const size_t> periods, const AnomalyDetectionParams& params, Extras& extras) {
+  std::vector<T> series = to_series<T>(rb_series, params.interpolate);
+  return detect(std::span<const T>{series}, periods, params, extras);
+}
+
+// Detects anomalies in a string of packed little-endian values,
+// reading the bytes in place when they are suitably aligned
+template<typename T>
+Rice::Array detect_packed(VALUE str, std::span<const size_t> periods, const AnomalyDetectionParams& params, Extras& extras) {
+  // a frozen copy shares the buffer, so it stays valid
+  // if the original is modified while the GVL is released
+  VALUE frozen = rb_str_new_frozen(str);
+  const char* ptr = RSTRING_PTR(frozen);
+  auto len = static_cast<size_t>(RSTRING_LEN(frozen));
+  if (len % sizeof(T) != 0) {
+    throw std::invalid_argument("series must contain a whole number of values");
+  }
+
+  Rice::Array res;
+  if (std::endian::native == std::endian::little && reinterpret_cast<uintptr_t>(ptr) % alignof(T) == 0) {
+    res = detect(std::span<const T>{reinterpret_cast<const T*>(ptr), len / sizeof(T)}, periods, params, extras);
+  } else {
+    std::vector<T> series(len / sizeof(T));
+    auto bytes = reinterpret_cast<unsigned char*>(series.data());
+    std::memcpy(bytes, ptr, len);
+    if (std::endian::native != std::endian::little) {
+      for (size_t i = 0; i < len; i += sizeof(T)) {
+        std::reverse(bytes + i, bytes + i + sizeof(T));
+      }
+    }
+    res = detect(std::span<const T>{series}, periods, params, extras);
+  }
+  RB_GC_GUARD(frozen);
+  return res;
+}
+
+class MemoryView {
+  public:
+    explicit MemoryView(VALUE obj) {
+      if (!rb_memory_view_get(obj, &view_, RUBY_MEMORY_VIEW_FORMAT | RUBY_MEMORY_VIEW_ROW_MAJOR)) {
+        throw std::invalid_argument("unable to get memory view");
+      }
+    }
+
+    MemoryView(const MemoryView&) = delete;
+    MemoryView& operator=(const MemoryView&) = delete;
+
+    ~MemoryView() {
+      rb_memory_view_release(&view_);
+    }
+
+    const rb_memory_view_t& operator*() const {
+      return view_;
+    }
+
+  private:
+    rb_memory_view_t view_;
+};
+
+// Detects anomalies in an object that exports a memory view (like Numo::NArray)
+Rice::Array detect_view(VALUE obj, std::span<const size_t> periods, const AnomalyDetectionParams& params, Extras& extras) {
+  MemoryView view{obj};
+  if ((*view).ndim > 1 || !rb_memory_view_is_contiguous(&*view)) {
+    throw std::invalid_argument("series must be one-dimensional and contiguous");
+  }
+
+  std::string format = (*view).format == nullptr ? "" : (*view).format;
+  bool little = std::endian::native == std::endian::little;
+  if (format == "f" || format == "F" || (format == "e" && little)) {
+    auto data = static_cast<const float*>((*view).data);
+    return detect(std::span<const float>{data, static_cast<size_t>((*view).byte_size) / sizeof(float)}, periods, params, extras);
+  } else if (format == "d" || format == "D" || (format == "E" && little)) {
+    auto data = static_cast<const double*>((*view).data);
+    return detect(std::span<const double>{data, static_cast<size_t>((*view).byte_size) / sizeof(double)}, periods, params, extras);
+  } else {
+    throw std::invalid_argument("series must contain float32 or float64 values");
+  }
+}
+
+template<typename T>
+Rice::Array detect_timestamps(const std::vector<int64_t>& timestamps, Rice::Array rb_series, size_t period, const AnomalyDetectionParams& params, Extras& extras) {
+  std::vector<T> series = to_series<T>(rb_series, params.interpolate);
+  std::vector<int64_t> anomalies = detect_without_gvl(params, [&](const AnomalyDetectionParams& p) {
+    TimestampAnomalyDetection res{timestamps, series, period, p};
+    extras.stats = res.stats();
+    extras.details = res.details();
+    extras.imputed = res.imputed();
+    return res.anomalies();
+  });
+  return to_ruby(anomalies);
+}
+
+template<typename T>
+Rice::Array detect_many(Rice::Array rb_series_list, size_t period, const AnomalyDetectionParams& params, size_t threads) {
+  std::vector<std::vector<T>> series_list;
+  series_list.reserve(static_cast<size_t>(rb_series_list.size()));
+  for (long i = 0; i < rb_series_list.size(); i++) {
+    series_list.push_back(Rice::Array(rb_ary_entry(rb_series_list.value(), i)).to_vector<T>());
+  }
+
+  BatchAnomalyDetection res = detect_without_gvl(params, [&](const AnomalyDetectionParams& p) {
+    return BatchAnomalyDetection{series_list, period, p, threads};
+  });
+
+  // errors are returned as messages
+  Rice::Array a;
+  for (size_t i = 0; i < res.size(); i++) {
+    const std::optional<std::string>& error = res.error(i);
+    if (error) {
+      a.push(Rice::String(error.value()), false);
+    } else {
+      a.push(to_ruby(res.anomalies(i)), false);
+    }
+  }
+  return a;
+}
+
+template<typename T>
+void define_decomposition(Rice::Module& rb_mAnomalyDetection, const char* name) {
+  Rice::define_class_under<Decomposition<T>>(rb_mAnomalyDetection, name)
+    .define_singleton_function(
+      "_new",
+      [](Rice::Array rb_series, size_t period) {
+        std::vector<T> series = rb_series.to_vector<T>();
+        return detect_without_gvl(DecompositionParams(), [&](const DecompositionParams& p) {
+          return Decomposition<T>{series, period, p};
+        });
+      })
+    .define_method(
+      "_detect",
+      [](Decomposition<T>& self, float k, float alpha, Rice::String rb_direction, bool verbose) {
+        AnomalyDetectionParams params{
+          .alpha = alpha,
+          .max_anoms = k,
+          .direction = parse_direction(rb_direction),
+          .verbose = verbose
+        };
+        std::vector<size_t> anomalies = detect_without_gvl(params, [&](const AnomalyDetectionParams& p) {
+          return AnomalyDetection{self, p}.anomalies();
+        });
+        return to_ruby(anomalies);
+      });
+}
+
+} // namespace
 
 extern "C"
 void Init_ext() {
@@ -18,34 +391,96 @@ void Init_ext() {
   rb_mAnomalyDetection
     .define_singleton_function(
       "_detect",
-      [](Rice::Array rb_series, size_t period, float k, float alpha, Rice::String rb_direction, bool verbose) {
-        std::vector<float> series = rb_series.to_vector<float>();
-        std::string direction = rb_direction.str();
-
-        Direction dir;
-        if (direction == "pos") {
-          dir = Direction::Positive;
-        } else if (direction == "neg") {
-          dir = Direction::Negative;
-        } else if (direction == "both") {
-          dir = Direction::Both;
+      [](Rice::Object rb_series, Rice::Array rb_periods, float k, float alpha, Rice::String rb_direction, bool verbose, Rice::String rb_dtype, size_t threads, size_t stop_after, std::optional<size_t> window_length, std::optional<float> robustness_tolerance, bool interpolate, Rice::Object rb_stats, Rice::Object rb_details, Rice::Object rb_imputed) {
+        AnomalyDetectionParams params = make_params(k, alpha, rb_direction, verbose, threads, stop_after, window_length, robustness_tolerance, interpolate, rb_stats, rb_details);
+
+        Dtype dtype = parse_dtype(rb_dtype);
+        std::vector<size_t> periods = rb_periods.to_vector<size_t>();
+
+        Extras extras;
+        Rice::Array res;
+        VALUE obj = rb_series.value();
+        if (RB_TYPE_P(obj, T_STRING)) {
+          if (dtype == Dtype::Float64) {
+            res = detect_packed<double>(obj, periods, params, extras);
+          } else {
+            res = detect_packed<float>(obj, periods, params, extras);
+          }
+        } else if (!RB_TYPE_P(obj, T_ARRAY) && rb_memory_view_available_p(obj)) {
+          // use the type of the view to avoid a copy
+          res = detect_view(obj, periods, params, extras);
+        } else if (dtype == Dtype::Float64) {
+          res = detect_array<double>(Rice::Array(obj), periods, params, extras);
         } else {
-          throw std::invalid_argument("direction must be pos, neg, or both");
+          res = detect_array<float>(Rice::Array(obj), periods, params, extras);
+        }
+
+        set_extras(rb_stats, rb_details, rb_imputed, extras);
+        return res;
+      })
+    .define_singleton_function(
+      "_detect_timestamps",
+      [](Rice::Array rb_timestamps, Rice::Array rb_series, size_t period, float k, float alpha, Rice::String rb_direction, bool verbose, Rice::String rb_dtype, size_t threads, size_t stop_after, std::optional<size_t> window_length, std::optional<float> robustness_tolerance, bool interpolate, Rice::Object rb_stats, Rice::Object rb_details, Rice::Object rb_imputed) {
+        AnomalyDetectionParams params = make_params(k, alpha, rb_direction, verbose, threads, stop_after, window_length, robustness_tolerance, interpolate, rb_stats, rb_details);
+
+        std::vector<int64_t> timestamps = rb_timestamps.to_vector<int64_t>();
+
+        // a period of 0 is inferred from the timestamps
+        if (period == 0) {
+          period = anomaly_detection::infer_period(timestamps);
+          if (verbose) {
+            std::cout << "Set period to " << period << std::endl;
+          }
         }
 
+        Extras extras;
+        Rice::Array res = parse_dtype(rb_dtype) == Dtype::Float64
+          ? detect_timestamps<double>(timestamps, rb_series, period, params, extras)
+          : detect_timestamps<float>(timestamps, rb_series, period, params, extras);
+
+        set_extras(rb_stats, rb_details, rb_imputed, extras);
+        return res;
+      })
+    .define_singleton_function(
+      "_detect_many",
+      [](Rice::Array rb_series_list, size_t period, float k, float alpha, Rice::String rb_direction, size_t threads, Rice::String rb_dtype) {
         AnomalyDetectionParams params{
           .alpha = alpha,
           .max_anoms = k,
-          .direction = dir,
-          .verbose = verbose,
-          .callback = rb_thread_check_ints
+          .direction = parse_direction(rb_direction)
         };
-        AnomalyDetection res{series, period, params};
 
-        Rice::Array a;
-        for (const auto v : res.anomalies()) {
-          a.push(v, false);
+        if (parse_dtype(rb_dtype) == Dtype::Float64) {
+          return detect_many<double>(rb_series_list, period, params, threads);
+        }
+        return detect_many<float>(rb_series_list, period, params, threads);
+      });
+
+  define_decomposition<float>(rb_mAnomalyDetection, "FloatDecomposition");
+  define_decomposition<double>(rb_mAnomalyDetection, "DoubleDecomposition");
+
+  Rice::define_class_under<StreamingAnomalyDetection<double>>(rb_mAnomalyDetection, "DoubleStream")
+    .define_singleton_function(
+      "_new",
+      [](size_t period, size_t periods, float alpha, Rice::String rb_direction, std::optional<float> robustness_tolerance) {
+        AnomalyDetectionParams params{
+          .alpha = alpha,
+          .direction = parse_direction(rb_direction),
+          .robustness_tolerance = robustness_tolerance
+        };
+        return StreamingAnomalyDetection<double>{period, periods, params};
+      })
+    .define_method(
+      "_add",
+      [](StreamingAnomalyDetection<double>& self, double value) {
+        bool anomaly = self.push(value);
+        // refit without the GVL, so other threads are not stalled once per period
+        if (self.refit_due()) {
+          detect_without_gvl(AnomalyDetectionParams(), [&](const AnomalyDetectionParams& p) {
+            self.refit(p.cancelled);
+            return true;
+          });
         }
-        return a;
+        return anomaly;
       });
 }
@@ -2,4 +2,7 @@ require "mkmf-rice"
 
 $CXXFLAGS += " -std=c++20 $(optflags)"
 
+# bounds checks in the kernels are for tests (like valgrind)
+$CXXFLAGS += " -DSTL_UNCHECKED" unless ENV["ANOMALY_DETECTION_CHECKED"]
+
 create_makefile("anomaly_detection/ext")
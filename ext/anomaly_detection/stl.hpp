@@ -17,12 +17,19 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <span>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -31,97 +38,491 @@ namespace stl {
 
 namespace detail {
 
+// Element access in the kernels is bounds-checked unless STL_UNCHECKED is defined,
+// which release builds can use to remove the checks from the inner loops
+#ifdef STL_UNCHECKED
+inline constexpr bool checked_access = false;
+#else
+inline constexpr bool checked_access = true;
+#endif
+
 // TODO use span.at() for C++26
 template<typename T>
 T& span_at(std::span<T> sp, size_t pos) {
-    if (pos >= sp.size()) [[unlikely]] {
-        throw std::out_of_range("pos >= size()");
+    if constexpr (checked_access) {
+        if (pos >= sp.size()) [[unlikely]] {
+            throw std::out_of_range("pos >= size()");
+        }
     }
     return sp[pos];
 }
 
 template<typename T>
-bool est(
-    const std::vector<T>& y,
-    size_t n,
-    size_t len,
-    int ideg,
-    T xs,
-    T& ys,
-    size_t nleft,
-    size_t nright,
-    std::vector<T>& w,
-    bool userw,
-    const std::vector<T>& rw
-) {
-    T range = static_cast<T>(n) - static_cast<T>(1.0);
+T& at(std::vector<T>& v, size_t pos) {
+    if constexpr (checked_access) {
+        return v.at(pos);
+    } else {
+        return v[pos];
+    }
+}
+
+template<typename T>
+const T& at(const std::vector<T>& v, size_t pos) {
+    if constexpr (checked_access) {
+        return v.at(pos);
+    } else {
+        return v[pos];
+    }
+}
+
+// Returns the bytes held by a vector, not including what its elements hold
+template<typename T>
+size_t vector_bytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+inline void check_cancelled(const std::atomic<bool>* cancelled) {
+    if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) [[unlikely]] {
+        throw std::runtime_error{"cancelled"};
+    }
+}
+
+// Runs func(i, t) for i in [0, n) on a pool of threads, where t is the index
+// of the thread (for per-thread state). Each thread starts with a contiguous
+// range of tasks and steals from the end of other ranges when its own range
+// is exhausted. The first exception stops the remaining tasks and is rethrown.
+template<typename F>
+void parallel_for(size_t n, size_t threads, F&& func) {
+    threads = std::min(threads, n);
+    if (threads <= 1) {
+        for (size_t i = 0; i < n; i++) {
+            func(i, 0);
+        }
+        return;
+    }
+
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::vector<Range> ranges(threads);
+    for (size_t t = 0; t < threads; t++) {
+        ranges.at(t).begin = n * t / threads;
+        ranges.at(t).end = n * (t + 1) / threads;
+    }
+
+    std::atomic<bool> failed = false;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&](size_t t) {
+        while (!failed.load(std::memory_order_relaxed)) {
+            std::optional<size_t> task;
+            for (size_t o = 0; o < threads && !task; o++) {
+                Range& range = ranges.at((t + o) % threads);
+                std::lock_guard<std::mutex> lock{range.mutex};
+                if (range.begin < range.end) {
+                    if (o == 0) {
+                        task = range.begin;
+                        range.begin += 1;
+                    } else {
+                        range.end -= 1;
+                        task = range.end;
+                    }
+                }
+            }
+            if (!task) {
+                return;
+            }
+            try {
+                func(task.value(), t);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock{error_mutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    try {
+        for (size_t t = 1; t < threads; t++) {
+            pool.emplace_back(worker, t);
+        }
+    } catch (const std::system_error&) {
+        // remaining ranges are stolen by the threads that did start
+    }
+    worker(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// uses the number of hardware threads for 0
+inline size_t num_threads(size_t threads) {
+    if (threads == 0) {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    return threads;
+}
+
+template<typename T>
+T bandwidth(size_t n, size_t len, T xs, size_t nleft, size_t nright) {
     T h = std::max(xs - static_cast<T>(nleft), static_cast<T>(nright) - xs);
 
     if (len > n) {
         h += static_cast<T>((len - n) / 2);
     }
 
+    return h;
+}
+
+// fused multiply-adds are disabled for the weights and sums of est,
+// so the results do not depend on the instruction set
+#if defined(__GNUC__) && !defined(__clang__)
+#define STL_NO_FP_CONTRACT [[gnu::optimize("fp-contract=off")]]
+#else
+#define STL_NO_FP_CONTRACT
+#endif
+
+template<typename T>
+STL_NO_FP_CONTRACT T tricube(T r, T h, T h1, T h9) {
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+    T q = r / h;
+    T t = static_cast<T>(1.0) - q * q * q;
+    T w = t * t * t;
+    return r <= h1 ? static_cast<T>(1.0) : (r <= h9 ? w : static_cast<T>(0.0));
+}
+
+// weighted sums for the local fit of est, with positions relative to xs
+template<typename T>
+struct EstSums {
+    T w = 0.0;
+    T wu = 0.0;
+    T wuu = 0.0;
+    T wy = 0.0;
+    T wuy = 0.0;
+};
+
+// the number of partial sums kept for each of EstSums, which is fixed
+// so the terms are added in the same order with every instruction set
+constexpr size_t est_lanes = 8;
+
+// a block of Width lanes, which maps to a SIMD register
+template<typename T, size_t Width>
+struct EstVec {
+#if defined(__GNUC__) || defined(__clang__)
+    using type [[gnu::vector_size(Width * sizeof(T))]] = T;
+    using unaligned [[gnu::vector_size(Width * sizeof(T)), gnu::aligned(alignof(T)), gnu::may_alias]] = T;
+#endif
+};
+
+template<typename T>
+struct EstVec<T, 1> {
+    using type = T;
+    using unaligned = T;
+};
+
+// the number of lanes per block for 16-byte vectors
+template<typename T>
+constexpr size_t est_width() {
+#if defined(__GNUC__) || defined(__clang__)
+    return 16 / sizeof(T);
+#else
+    return 1;
+#endif
+}
+
+// computes the weights and the sums of est in a single pass, with the weights
+// either looked up (indexed by j - 1) or computed from the distance to xs
+template<typename T, size_t Width, bool Table, bool Userw>
+[[gnu::always_inline]] STL_NO_FP_CONTRACT inline EstSums<T> est_sums_impl(
+    const T* y,
+    const T* rw,
+    const T* table,
+    size_t nleft,
+    size_t nright,
+    T xs,
+    T h
+) {
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+    using V = typename EstVec<T, Width>::type;
+    using U = typename EstVec<T, Width>::unaligned;
+    constexpr size_t blocks = est_lanes / Width;
+
     T h9 = static_cast<T>(0.999) * h;
     T h1 = static_cast<T>(0.001) * h;
 
-    // compute weights
-    T a = 0.0;
-    for (size_t j = nleft; j <= nright; j++) {
-        w.at(j - 1) = 0.0;
-        T r = std::abs(static_cast<T>(j) - xs);
-        if (r <= h9) {
-            if (r <= h1) {
-                w.at(j - 1) = 1.0;
-            } else {
-                w.at(j - 1) = static_cast<T>(std::pow(1.0 - std::pow(r / h, 3.0), 3.0));
-            }
-            if (userw) {
-                w.at(j - 1) *= rw.at(j - 1);
-            }
-            a += w.at(j - 1);
-        }
+    V lane[blocks];
+    T offsets[est_lanes];
+    std::iota(std::begin(offsets), std::end(offsets), static_cast<T>(0.0));
+    std::memcpy(lane, offsets, sizeof(lane));
+
+    V zero = {};
+    V one = zero + static_cast<T>(1.0);
+
+    V sw[blocks] = {};
+    V swu[blocks] = {};
+    V swuu[blocks] = {};
+    V swy[blocks] = {};
+    V swuy[blocks] = {};
+
+    // positions are integers, so they can be stepped instead of converted
+    V u[blocks];
+    for (size_t b = 0; b < blocks; b++) {
+        u[b] = lane[b] + (static_cast<T>(nleft) - xs);
     }
 
-    if (a <= 0.0) {
-        return false;
-    } else {
-        // weighted least squares
-        for (size_t j = nleft; j <= nright; j++) {
-            // make sum of w(j) == 1
-            w.at(j - 1) /= a;
-        }
-
-        if (h > 0.0 && ideg > 0) {
-            // use linear fit
-            T a = 0.0;
-            for (size_t j = nleft; j <= nright; j++) {
-                // weighted center of x values
-                a += w.at(j - 1) * static_cast<T>(j);
+    for (size_t i = nleft - 1; i < nright; i += est_lanes) {
+        size_t count = std::min(est_lanes, nright - i);
+
+        // the last block is padded with zero weights
+        V yv[blocks] = {};
+        V w[blocks] = {};
+        V rwv[blocks] = {};
+        if (count == est_lanes) [[likely]] {
+            for (size_t b = 0; b < blocks; b++) {
+                yv[b] = *reinterpret_cast<const U*>(y + i + b * Width);
+                if constexpr (Table) {
+                    w[b] = *reinterpret_cast<const U*>(table + i + b * Width);
+                }
+                if constexpr (Userw) {
+                    rwv[b] = *reinterpret_cast<const U*>(rw + i + b * Width);
+                }
+            }
+        } else {
+            std::memcpy(yv, y + i, count * sizeof(T));
+            if constexpr (Table) {
+                std::memcpy(w, table + i, count * sizeof(T));
             }
-            T b = xs - a;
-            T c = 0.0;
-            for (size_t j = nleft; j <= nright; j++) {
-                c += w.at(j - 1) * std::pow(static_cast<T>(j) - a, static_cast<T>(2.0));
+            if constexpr (Userw) {
+                std::memcpy(rwv, rw + i, count * sizeof(T));
             }
-            if (std::sqrt(c) > 0.001 * range) {
-                b /= c;
+        }
 
-                // points are spread out enough to compute slope
-                for (size_t j = nleft; j <= nright; j++) {
-                    w.at(j - 1) *= b * (static_cast<T>(j) - a) + static_cast<T>(1.0);
+        for (size_t b = 0; b < blocks; b++) {
+            if constexpr (!Table) {
+                V r = u[b] < zero ? -u[b] : u[b];
+                V q = r / h;
+                V t = one - q * q * q;
+                V c = t * t * t;
+                w[b] = r <= h1 ? one : (r <= h9 ? c : zero);
+                if (count != est_lanes) {
+                    w[b] = lane[b] < static_cast<T>(count) ? w[b] : zero;
                 }
             }
+            if constexpr (Userw) {
+                w[b] *= rwv[b];
+            }
+
+            V wy = w[b] * yv[b];
+            sw[b] += w[b];
+            swu[b] += w[b] * u[b];
+            swuu[b] += w[b] * u[b] * u[b];
+            swy[b] += wy;
+            swuy[b] += wy * u[b];
+
+            u[b] += static_cast<T>(est_lanes);
         }
+    }
 
-        ys = 0.0;
-        for (size_t j = nleft; j <= nright; j++) {
-            ys += w.at(j - 1) * y.at(j - 1);
+    auto reduce = [](const V (&s)[blocks]) {
+        T l[est_lanes];
+        std::memcpy(l, s, sizeof(l));
+        return ((l[0] + l[1]) + (l[2] + l[3])) + ((l[4] + l[5]) + (l[6] + l[7]));
+    };
+
+    return EstSums<T>{reduce(sw), reduce(swu), reduce(swuu), reduce(swy), reduce(swuy)};
+}
+
+// GCC does not align the stack beyond 16 bytes on Windows (GCC bug 54412),
+// so the wider vectors on the stack of the kernel are only used elsewhere
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+#define STL_X86_DISPATCH
+
+// instantiates the kernel for wider vectors
+template<typename T, bool Table, bool Userw>
+[[gnu::target("avx2")]] STL_NO_FP_CONTRACT EstSums<T> est_sums_avx2(
+    const T* y,
+    const T* rw,
+    const T* table,
+    size_t nleft,
+    size_t nright,
+    T xs,
+    T h
+) {
+    return est_sums_impl<T, 32 / sizeof(T), Table, Userw>(y, rw, table, nleft, nright, xs, h);
+}
+
+template<typename T, bool Table, bool Userw>
+[[gnu::target("avx512f")]] STL_NO_FP_CONTRACT EstSums<T> est_sums_avx512(
+    const T* y,
+    const T* rw,
+    const T* table,
+    size_t nleft,
+    size_t nright,
+    T xs,
+    T h
+) {
+    return est_sums_impl<T, std::min(est_lanes, 64 / sizeof(T)), Table, Userw>(y, rw, table, nleft, nright, xs, h);
+}
+#endif
+
+enum class Isa {
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+inline Isa detect_isa() {
+#ifdef STL_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return Isa::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::Avx2;
+    }
+#endif
+    return Isa::Scalar;
+}
+
+inline Isa est_isa() {
+    static const Isa isa = detect_isa();
+    return isa;
+}
+
+template<typename T, bool Table, bool Userw>
+STL_NO_FP_CONTRACT EstSums<T> est_sums(
+    Isa isa,
+    const T* y,
+    const T* rw,
+    const T* table,
+    size_t nleft,
+    size_t nright,
+    T xs,
+    T h
+) {
+#ifdef STL_X86_DISPATCH
+    if (isa == Isa::Avx512) {
+        return est_sums_avx512<T, Table, Userw>(y, rw, table, nleft, nright, xs, h);
+    }
+    if (isa == Isa::Avx2) {
+        return est_sums_avx2<T, Table, Userw>(y, rw, table, nleft, nright, xs, h);
+    }
+#else
+    (void) isa;
+#endif
+    return est_sums_impl<T, est_width<T>(), Table, Userw>(y, rw, table, nleft, nright, xs, h);
+}
+
+// fits a weighted least squares line (or constant) from the sums,
+// which is the same as normalizing the weights, adjusting them for the slope,
+// and taking the dot product with y
+template<typename T>
+bool est_fit(const EstSums<T>& s, size_t n, int ideg, T h, T& ys) {
+    T range = static_cast<T>(n) - static_cast<T>(1.0);
+
+    if (s.w <= 0.0) {
+        return false;
+    }
+
+    if (h > 0.0 && ideg > 0) {
+        // use linear fit
+        // weighted center of x values, relative to xs
+        T a = s.wu / s.w;
+        T c = s.wuu / s.w - a * a;
+        if (std::sqrt(c) > 0.001 * range) {
+            // points are spread out enough to compute slope
+            T b = -a / c;
+            ys = (s.wy + b * (s.wuy - a * s.wy)) / s.w;
+            return true;
         }
+    }
+
+    ys = s.wy / s.w;
+    return true;
+}
+
+template<typename T>
+bool est(
+    const std::vector<T>& y,
+    size_t n,
+    size_t len,
+    int ideg,
+    T xs,
+    T& ys,
+    size_t nleft,
+    size_t nright,
+    bool userw,
+    const std::vector<T>& rw
+) {
+    if (nleft < 1 || nright > n || n > y.size() || (userw && n > rw.size())) [[unlikely]] {
+        throw std::out_of_range("pos >= size()");
+    }
 
-        return true;
+    T h = bandwidth(n, len, xs, nleft, nright);
+
+    EstSums<T> s = userw
+        ? est_sums<T, false, true>(est_isa(), y.data(), rw.data(), nullptr, nleft, nright, xs, h)
+        : est_sums<T, false, false>(est_isa(), y.data(), nullptr, nullptr, nleft, nright, xs, h);
+
+    return est_fit(s, n, ideg, h, ys);
+}
+
+// computes the tricube weights of est by distance from xs
+template<typename T>
+void tricube_table(T h, size_t max_distance, std::vector<T>& table) {
+    T h9 = static_cast<T>(0.999) * h;
+    T h1 = static_cast<T>(0.001) * h;
+
+    table.resize(max_distance + 1);
+    for (size_t d = 0; d <= max_distance; d++) {
+        at(table, d) = tricube(static_cast<T>(d), h, h1, h9);
     }
 }
 
+// same as est for integer xs, with weights looked up
+// (table[j - 1] is the weight for y[j - 1])
+template<typename T>
+bool est_table(
+    const std::vector<T>& y,
+    size_t n,
+    int ideg,
+    size_t xs,
+    T& ys,
+    size_t nleft,
+    size_t nright,
+    bool userw,
+    const std::vector<T>& rw,
+    std::span<const T> table,
+    T h
+) {
+    if (nleft < 1 || nright > n || n > y.size() || nright > table.size() || (userw && n > rw.size())) [[unlikely]] {
+        throw std::out_of_range("pos >= size()");
+    }
+
+    auto x = static_cast<T>(xs);
+    EstSums<T> s = userw
+        ? est_sums<T, true, true>(est_isa(), y.data(), rw.data(), table.data(), nleft, nright, x, h)
+        : est_sums<T, true, false>(est_isa(), y.data(), nullptr, table.data(), nleft, nright, x, h);
+
+    return est_fit(s, n, ideg, h, ys);
+}
+
 template<typename T>
 void ess(
     const std::vector<T>& y,
@@ -131,11 +532,10 @@ void ess(
     size_t njump,
     bool userw,
     const std::vector<T>& rw,
-    std::span<T> ys,
-    std::vector<T>& res
+    std::span<T> ys
 ) {
     if (n < 2) {
-        span_at(ys, 0) = y.at(0);
+        span_at(ys, 0) = at(y, 0);
         return;
     }
 
@@ -148,11 +548,10 @@ void ess(
         nright = n;
         for (size_t i = 1; i <= n; i += newnj) {
             bool ok = est(
-                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, res, userw,
-                rw
+                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, userw, rw
             );
             if (!ok) {
-                span_at(ys, i - 1) = y.at(i - 1);
+                span_at(ys, i - 1) = at(y, i - 1);
             }
         }
     } else if (newnj == 1) {
@@ -167,11 +566,10 @@ void ess(
                 nright += 1;
             }
             bool ok = est(
-                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, res, userw,
-                rw
+                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, userw, rw
             );
             if (!ok) {
-                span_at(ys, i - 1) = y.at(i - 1);
+                span_at(ys, i - 1) = at(y, i - 1);
             }
         }
     } else {
@@ -190,11 +588,10 @@ void ess(
                 nright = len + i - nsh;
             }
             bool ok = est(
-                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, res, userw,
-                rw
+                y, n, len, ideg, static_cast<T>(i), span_at(ys, i - 1), nleft, nright, userw, rw
             );
             if (!ok) {
-                span_at(ys, i - 1) = y.at(i - 1);
+                span_at(ys, i - 1) = at(y, i - 1);
             }
         }
     }
@@ -209,11 +606,10 @@ void ess(
         size_t k = ((n - 1) / newnj) * newnj + 1;
         if (k != n) {
             bool ok = est(
-                y, n, len, ideg, static_cast<T>(n), span_at(ys, n - 1), nleft, nright, res, userw,
-                rw
+                y, n, len, ideg, static_cast<T>(n), span_at(ys, n - 1), nleft, nright, userw, rw
             );
             if (!ok) {
-                span_at(ys, n - 1) = y.at(n - 1);
+                span_at(ys, n - 1) = at(y, n - 1);
             }
             if (k != n - 1) {
                 T delta = (span_at(ys, n - 1) - span_at(ys, k - 1)) / static_cast<T>(n - k);
@@ -225,6 +621,37 @@ void ess(
     }
 }
 
+// same as ess when len >= n and njump >= n - 1,
+// with the weights of the fits at 1 and n looked up
+template<typename T>
+void ess_periodic(
+    const std::vector<T>& y,
+    size_t n,
+    int ideg,
+    bool userw,
+    const std::vector<T>& rw,
+    std::span<T> ys,
+    std::span<const T> first,
+    std::span<const T> last,
+    T h
+) {
+    bool ok = est_table(y, n, ideg, 1, span_at(ys, 0), 1, n, userw, rw, first, h);
+    if (!ok) {
+        span_at(ys, 0) = at(y, 0);
+    }
+    ok = est_table(y, n, ideg, n, span_at(ys, n - 1), 1, n, userw, rw, last, h);
+    if (!ok) {
+        span_at(ys, n - 1) = at(y, n - 1);
+    }
+
+    if (n > 2) {
+        T delta = (span_at(ys, n - 1) - span_at(ys, 0)) / static_cast<T>(n - 1);
+        for (size_t j = 2; j <= n - 1; j++) {
+            span_at(ys, j - 1) = span_at(ys, 0) + delta * static_cast<T>(j - 1);
+        }
+    }
+}
+
 template<typename T>
 void ma(const std::vector<T>& x, size_t n, size_t len, std::vector<T>& ave) {
     size_t newn = n - len + 1;
@@ -233,17 +660,17 @@ void ma(const std::vector<T>& x, size_t n, size_t len, std::vector<T>& ave) {
 
     // get the first average
     for (size_t i = 0; i < len; i++) {
-        v += x.at(i);
+        v += at(x, i);
     }
 
-    ave.at(0) = static_cast<T>(v / flen);
+    at(ave, 0) = static_cast<T>(v / flen);
     if (newn > 1) {
         size_t k = len;
         size_t m = 0;
         for (size_t j = 1; j < newn; j++) {
             // window down the array
-            v = v - x.at(m) + x.at(k);
-            ave.at(j) = static_cast<T>(v / flen);
+            v = v - at(x, m) + at(x, k);
+            at(ave, j) = static_cast<T>(v / flen);
             k += 1;
             m += 1;
         }
@@ -267,35 +694,57 @@ template<typename T>
 void rwts(std::span<const T> y, const std::vector<T>& fit, std::vector<T>& rw) {
     // TODO use std::views::zip for C++23
     for (size_t i = 0; i < y.size(); i++) {
-        rw.at(i) = std::abs(span_at(y, i) - fit.at(i));
+        at(rw, i) = std::abs(span_at(y, i) - at(fit, i));
     }
 
     size_t n = y.size();
     size_t mid1 = (n - 1) / 2;
     size_t mid2 = n / 2;
 
-    // sort
-    std::ranges::sort(rw);
+    // select the middle values instead of sorting
+    auto upper = rw.begin() + static_cast<ptrdiff_t>(mid2);
+    std::ranges::nth_element(rw, upper);
+    T lower = mid1 == mid2 ? *upper : *std::max_element(rw.begin(), upper);
 
-    T cmad = static_cast<T>(3.0) * (rw.at(mid1) + rw.at(mid2)); // 6 * median abs resid
+    T cmad = static_cast<T>(3.0) * (lower + *upper); // 6 * median abs resid
     T c9 = static_cast<T>(0.999) * cmad;
     T c1 = static_cast<T>(0.001) * cmad;
 
     // TODO use std::views::zip for C++23
     for (size_t i = 0; i < y.size(); i++) {
-        T r = std::abs(span_at(y, i) - fit.at(i));
+        T r = std::abs(span_at(y, i) - at(fit, i));
         if (r <= c1) {
-            rw.at(i) = 1.0;
+            at(rw, i) = 1.0;
         } else if (r <= c9) {
-            rw.at(i) = static_cast<T>(std::pow(1.0 - std::pow(r / cmad, 2.0), 2.0));
+            at(rw, i) = static_cast<T>(std::pow(1.0 - std::pow(r / cmad, 2.0), 2.0));
         } else {
-            rw.at(i) = 0.0;
+            at(rw, i) = 0.0;
         }
     }
 }
 
+// tricube weights for cycle-subseries that fit in a single window, cached by length
 template<typename T>
-void ss(
+struct SsTables {
+    size_t k = 0;
+    size_t ns = 0;
+    T inner_h = 0.0;
+    T outer_h = 0.0;
+    std::vector<T> inner;
+    std::vector<T> inner_rev;
+    std::vector<T> outer;
+    std::vector<T> outer_rev;
+
+    // Returns the bytes of the tables
+    size_t bytes() const {
+        return vector_bytes(inner) + vector_bytes(inner_rev) + vector_bytes(outer) + vector_bytes(outer_rev);
+    }
+};
+
+// smooths the j-th cycle-subseries, using the periodic fast path when it
+// applies unless disabled (to check it against ess and est)
+template<typename T>
+void ss_subseries(
     const std::vector<T>& y,
     size_t n,
     size_t np,
@@ -303,43 +752,156 @@ void ss(
     int isdeg,
     size_t nsjump,
     bool userw,
-    std::vector<T>& rw,
+    const std::vector<T>& rw,
     std::vector<T>& season,
+    size_t j,
     std::vector<T>& work1,
     std::vector<T>& work2,
     std::vector<T>& work3,
-    std::vector<T>& work4
+    SsTables<T>& tables,
+    bool fast = true
 ) {
-    for (size_t j = 1; j <= np; j++) {
-        size_t k = (n - j) / np + 1;
+    // integer positions are only exact in T up to this
+    constexpr size_t max_exact = size_t{1} << std::numeric_limits<T>::digits;
+
+    size_t k = (n - j) / np + 1;
 
+    for (size_t i = 1; i <= k; i++) {
+        at(work1, i - 1) = at(y, (i - 1) * np + j - 1);
+    }
+    if (userw) {
         for (size_t i = 1; i <= k; i++) {
-            work1.at(i - 1) = y.at((i - 1) * np + j - 1);
-        }
-        if (userw) {
-            for (size_t i = 1; i <= k; i++) {
-                work3.at(i - 1) = rw.at((i - 1) * np + j - 1);
-            }
+            at(work3, i - 1) = at(rw, (i - 1) * np + j - 1);
         }
-        ess(work1, k, ns, isdeg, nsjump, userw, work3, std::span{work2}.subspan(1), work4);
-        T xs = 0.0;
-        size_t nright = std::min(ns, k);
-        bool ok = est(work1, k, ns, isdeg, xs, work2.at(0), 1, nright, work4, userw, work3);
-        if (!ok) {
-            work2.at(0) = work2.at(1);
+    }
+    // when the seasonal smoother spans the whole cycle-subseries (like with
+    // a periodic seasonal_length), ess only fits at the ends and interpolates,
+    // and the weights of each fit depend only on the distance from xs
+    bool periodic = fast && ns >= k && nsjump + 1 >= k && k >= 2 && k + 1 < max_exact;
+    if (periodic) {
+        if (k != tables.k || ns != tables.ns) {
+            tables.inner_h = bandwidth(k, ns, static_cast<T>(1), 1, k);
+            tables.outer_h = bandwidth(k, ns, static_cast<T>(0), 1, k);
+            tricube_table(tables.inner_h, k - 1, tables.inner);
+            tricube_table(tables.outer_h, k, tables.outer);
+            tables.inner_rev.assign(tables.inner.rbegin(), tables.inner.rend());
+            tables.outer_rev.assign(tables.outer.rbegin(), tables.outer.rend());
+            tables.k = k;
+            tables.ns = ns;
         }
-        xs = static_cast<T>(k + 1);
-        size_t nleft = static_cast<size_t>(
-            std::max(1, static_cast<int>(k) - static_cast<int>(ns) + 1)
+        // index the weights by position (xs is 1, k, 0, and k + 1)
+        ess_periodic(
+            work1, k, isdeg, userw, work3, std::span{work2}.subspan(1),
+            std::span<const T>{tables.inner}, std::span<const T>{tables.inner_rev}, tables.inner_h
         );
-        ok = est(work1, k, ns, isdeg, xs, work2.at(k + 1), nleft, k, work4, userw, work3);
-        if (!ok) {
-            work2.at(k + 1) = work2.at(k);
-        }
-        for (size_t m = 1; m <= k + 2; m++) {
-            season.at((m - 1) * np + j - 1) = work2.at(m - 1);
+    } else {
+        ess(work1, k, ns, isdeg, nsjump, userw, work3, std::span{work2}.subspan(1));
+    }
+    T xs = 0.0;
+    size_t nright = std::min(ns, k);
+    bool ok = periodic
+        ? est_table(work1, k, isdeg, 0, at(work2, 0), 1, nright, userw, work3, std::span<const T>{tables.outer}.subspan(1), tables.outer_h)
+        : est(work1, k, ns, isdeg, xs, at(work2, 0), 1, nright, userw, work3);
+    if (!ok) {
+        at(work2, 0) = at(work2, 1);
+    }
+    xs = static_cast<T>(k + 1);
+    size_t nleft = static_cast<size_t>(
+        std::max(1, static_cast<int>(k) - static_cast<int>(ns) + 1)
+    );
+    ok = periodic
+        ? est_table(work1, k, isdeg, k + 1, at(work2, k + 1), nleft, k, userw, work3, std::span<const T>{tables.outer_rev}, tables.outer_h)
+        : est(work1, k, ns, isdeg, xs, at(work2, k + 1), nleft, k, userw, work3);
+    if (!ok) {
+        at(work2, k + 1) = at(work2, k);
+    }
+    for (size_t m = 1; m <= k + 2; m++) {
+        at(season, (m - 1) * np + j - 1) = at(work2, m - 1);
+    }
+}
+
+// scratch space for smoothing cycle-subseries on another thread
+template<typename T>
+struct SsWork {
+    std::vector<T> work1;
+    std::vector<T> work2;
+    std::vector<T> work3;
+    SsTables<T> tables;
+
+    // Returns the bytes of scratch space held
+    size_t bytes() const {
+        return vector_bytes(work1) + vector_bytes(work2) + vector_bytes(work3) + tables.bytes();
+    }
+};
+
+// scratch space for stl, which can be reused across decompositions
+template<typename T>
+struct StlWork {
+    std::vector<T> work1;
+    std::vector<T> work2;
+    std::vector<T> work3;
+    std::vector<T> work4;
+    std::vector<T> work5;
+    SsTables<T> tables;
+    std::vector<SsWork<T>> extra;
+    std::vector<T> prev_weights;
+
+    // Returns the bytes of scratch space held, including that of each thread
+    size_t bytes() const {
+        size_t total = vector_bytes(work1) + vector_bytes(work2) + vector_bytes(work3)
+            + vector_bytes(work4) + vector_bytes(work5) + tables.bytes()
+            + vector_bytes(extra) + vector_bytes(prev_weights);
+        for (const auto& w : extra) {
+            total += w.bytes();
         }
+        return total;
     }
+};
+
+template<typename T>
+void ss(
+    const std::vector<T>& y,
+    size_t n,
+    size_t np,
+    size_t ns,
+    int isdeg,
+    size_t nsjump,
+    bool userw,
+    std::vector<T>& rw,
+    std::vector<T>& season,
+    std::vector<T>& work1,
+    std::vector<T>& work2,
+    std::vector<T>& work3,
+    SsTables<T>& tables,
+    std::vector<SsWork<T>>& extra,
+    size_t threads,
+    const std::atomic<bool>* cancelled
+) {
+    threads = std::min(threads, np);
+
+    // the calling thread uses the work arrays, and the others get their own
+    if (extra.size() + 1 < threads) {
+        extra.resize(threads - 1);
+    }
+    size_t max_k = (n - 1) / np + 1;
+    for (size_t t = 1; t < threads; t++) {
+        SsWork<T>& w = at(extra, t - 1);
+        w.work1.resize(max_k);
+        w.work2.resize(max_k + 2);
+        w.work3.resize(max_k);
+    }
+
+    // subseries are independent and write to different positions of season
+    parallel_for(np, threads, [&](size_t i, size_t t) {
+        check_cancelled(cancelled);
+
+        if (t == 0) {
+            ss_subseries(y, n, np, ns, isdeg, nsjump, userw, rw, season, i + 1, work1, work2, work3, tables);
+        } else {
+            SsWork<T>& w = at(extra, t - 1);
+            ss_subseries(y, n, np, ns, isdeg, nsjump, userw, rw, season, i + 1, w.work1, w.work2, w.work3, w.tables);
+        }
+    });
 }
 
 template<typename T>
@@ -360,37 +922,45 @@ void onestp(
     std::vector<T>& rw,
     std::vector<T>& season,
     std::vector<T>& trend,
-    std::vector<T>& work1,
-    std::vector<T>& work2,
-    std::vector<T>& work3,
-    std::vector<T>& work4,
-    std::vector<T>& work5
+    StlWork<T>& work,
+    size_t threads,
+    const std::atomic<bool>* cancelled
 ) {
     size_t n = y.size();
+    std::vector<T>& work1 = work.work1;
+    std::vector<T>& work2 = work.work2;
+    std::vector<T>& work3 = work.work3;
+    std::vector<T>& work4 = work.work4;
+    std::vector<T>& work5 = work.work5;
 
     for (size_t j = 0; j < ni; j++) {
         // TODO use std::views::zip for C++23
         for (size_t i = 0; i < y.size(); i++) {
-            work1.at(i) = span_at(y, i) - trend.at(i);
+            at(work1, i) = span_at(y, i) - at(trend, i);
         }
 
-        ss(work1, n, np, ns, isdeg, nsjump, userw, rw, work2, work3, work4, work5, season);
+        ss(
+            work1, n, np, ns, isdeg, nsjump, userw, rw, work2, work3, work4, work5,
+            work.tables, work.extra, threads, cancelled
+        );
+        check_cancelled(cancelled);
         fts(work2, n + 2 * np, np, work3, work1);
-        ess(work3, n, nl, ildeg, nljump, false, work4, std::span{work1}, work5);
+        ess(work3, n, nl, ildeg, nljump, false, work4, std::span{work1});
         // TODO use std::views::zip for C++23
         for (size_t i = 0; i < n; i++) {
-            season.at(i) = work2.at(np + i) - work1.at(i);
+            at(season, i) = at(work2, np + i) - at(work1, i);
         }
         // TODO use std::views::zip for C++23
         for (size_t i = 0; i < y.size(); i++) {
-            work1.at(i) = span_at(y, i) - season.at(i);
+            at(work1, i) = span_at(y, i) - at(season, i);
         }
-        ess(work1, n, nt, itdeg, ntjump, userw, rw, std::span{trend}, work3);
+        ess(work1, n, nt, itdeg, ntjump, userw, rw, std::span{trend});
     }
 }
 
+// returns the number of outer loops run
 template<typename T>
-void stl(
+size_t stl(
     std::span<const T> y,
     size_t np,
     size_t ns,
@@ -404,9 +974,13 @@ void stl(
     size_t nljump,
     size_t ni,
     size_t no,
+    std::optional<float> tolerance,
     std::vector<T>& rw,
     std::vector<T>& season,
-    std::vector<T>& trend
+    std::vector<T>& trend,
+    StlWork<T>& work,
+    size_t threads,
+    const std::atomic<bool>* cancelled
 ) {
     size_t n = y.size();
 
@@ -443,11 +1017,12 @@ void stl(
         throw std::invalid_argument{"low_pass_length must be odd"};
     }
 
-    std::vector<T> work1(n + 2 * np);
-    std::vector<T> work2(n + 2 * np);
-    std::vector<T> work3(n + 2 * np);
-    std::vector<T> work4(n + 2 * np);
-    std::vector<T> work5(n + 2 * np);
+    // assign keeps the capacity of reused work arrays
+    work.work1.assign(n + 2 * np, 0.0);
+    work.work2.assign(n + 2 * np, 0.0);
+    work.work3.assign(n + 2 * np, 0.0);
+    work.work4.assign(n + 2 * np, 0.0);
+    work.work5.assign(n + 2 * np, 0.0);
 
     bool userw = false;
     size_t k = 0;
@@ -470,28 +1045,42 @@ void stl(
             rw,
             season,
             trend,
-            work1,
-            work2,
-            work3,
-            work4,
-            work5
+            work,
+            threads,
+            cancelled
         );
         k += 1;
         if (k > no) {
             break;
         }
         for (size_t i = 0; i < n; i++) {
-            work1.at(i) = trend.at(i) + season.at(i);
+            at(work.work1, i) = at(trend, i) + at(season, i);
+        }
+        if (tolerance.has_value() && userw) {
+            work.prev_weights.assign(rw.begin(), rw.end());
+        }
+        rwts(y, work.work1, rw);
+
+        // stop when the weights of the last fit are close to the new weights
+        if (tolerance.has_value() && userw) {
+            T change = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                change = std::max(change, std::abs(at(rw, i) - at(work.prev_weights, i)));
+            }
+            if (change <= *tolerance) {
+                break;
+            }
         }
-        rwts(y, work1, rw);
         userw = true;
     }
 
     if (no <= 0) {
         for (size_t i = 0; i < n; i++) {
-            rw.at(i) = 1.0;
+            at(rw, i) = 1.0;
         }
     }
+
+    return k - 1;
 }
 
 template<typename T>
@@ -544,57 +1133,28 @@ struct StlParams {
     std::optional<size_t> outer_loops = std::nullopt;
     /// Sets whether robustness iterations are to be used.
     bool robust = false;
+    /// Stops the robustness iterations once no weight changes by more than this.
+    std::optional<float> tolerance = std::nullopt;
+    /// Sets the number of threads for seasonal smoothing (0 uses the number of hardware threads).
+    size_t threads = 1;
+    /// Sets a flag to check for cancellation.
+    const std::atomic<bool>* cancelled = nullptr;
 };
 
-/// Seasonal-trend decomposition using Loess (STL).
-template<typename T = float>
-class Stl {
-  public:
-    /// Decomposes a time series from a vector.
-    Stl(const std::vector<T>& series, size_t period, const StlParams& params = StlParams());
-
-    /// Decomposes a time series from a span.
-    Stl(std::span<const T> series, size_t period, const StlParams& params = StlParams());
-
-    /// Returns the seasonal component.
-    const std::vector<T>& seasonal() const {
-        return seasonal_;
-    }
-
-    /// Returns the trend component.
-    const std::vector<T>& trend() const {
-        return trend_;
-    }
-
-    /// Returns the remainder.
-    const std::vector<T>& remainder() const {
-        return remainder_;
-    }
-
-    /// Returns the weights.
-    const std::vector<T>& weights() const {
-        return weights_;
-    }
-
-    /// Returns the seasonal strength.
-    double seasonal_strength() const {
-        return detail::strength(seasonal_, remainder_);
-    }
-
-    /// Returns the trend strength.
-    double trend_strength() const {
-        return detail::strength(trend_, remainder_);
-    }
-
-  private:
-    std::vector<T> seasonal_;
-    std::vector<T> trend_;
-    std::vector<T> remainder_;
-    std::vector<T> weights_;
-};
+namespace detail {
 
+// decomposes a time series into reused components and work arrays,
+// and returns the number of outer loops run
 template<typename T>
-Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params) {
+size_t fit(
+    std::span<const T> series,
+    size_t period,
+    const StlParams& params,
+    std::vector<T>& seasonal,
+    std::vector<T>& trend,
+    std::vector<T>& weights,
+    StlWork<T>& work
+) {
     std::span<const T> y = series;
     size_t np = period;
     size_t n = series.size();
@@ -603,15 +1163,19 @@ Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params) {
         throw std::invalid_argument{"series has less than two periods"};
     }
 
+    if (params.tolerance.has_value() && *params.tolerance < 0) {
+        throw std::invalid_argument{"tolerance must be non-negative"};
+    }
+
     size_t ns = params.seasonal_length.value_or(np);
 
     int isdeg = params.seasonal_degree;
     int itdeg = params.trend_degree;
 
-    std::vector<T> seasonal(n);
-    std::vector<T> trend(n);
-    std::vector<T> remainder;
-    std::vector<T> weights(n);
+    // assign keeps the capacity of reused components
+    seasonal.assign(n, 0.0);
+    trend.assign(n, 0.0);
+    weights.assign(n, 0.0);
 
     int ildeg = params.low_pass_degree.value_or(itdeg);
     size_t newns = std::max(ns, static_cast<size_t>(3));
@@ -647,7 +1211,7 @@ Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params) {
         static_cast<size_t>(std::ceil(static_cast<float>(nl) / 10.0))
     );
 
-    detail::stl(
+    return stl(
         y,
         newnp,
         newns,
@@ -661,27 +1225,122 @@ Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params) {
         nljump,
         ni,
         no,
+        params.tolerance,
         weights,
         seasonal,
-        trend
+        trend,
+        work,
+        num_threads(params.threads),
+        params.cancelled
     );
+}
 
-    remainder.reserve(n);
-    // TODO use std::views::zip for C++23
-    for (size_t i = 0; i < y.size(); i++) {
-        remainder.push_back(detail::span_at(y, i) - seasonal.at(i) - trend.at(i));
+} // namespace detail
+
+template<typename T>
+class Stl;
+
+/// Scratch space that can be reused across decompositions to avoid allocations.
+/// A workspace must not be used by multiple decompositions at the same time.
+template<typename T = float>
+class StlWorkspace {
+  private:
+    detail::StlWork<T> work_;
+
+    friend class Stl<T>;
+};
+
+/// Seasonal-trend decomposition using Loess (STL).
+template<typename T = float>
+class Stl {
+  public:
+    /// Decomposes a time series from a vector.
+    Stl(const std::vector<T>& series, size_t period, const StlParams& params = StlParams());
+
+    /// Decomposes a time series from a span.
+    Stl(std::span<const T> series, size_t period, const StlParams& params = StlParams());
+
+    /// Decomposes a time series from a vector, reusing a workspace.
+    Stl(const std::vector<T>& series, size_t period, const StlParams& params, StlWorkspace<T>& workspace);
+
+    /// Decomposes a time series from a span, reusing a workspace.
+    Stl(std::span<const T> series, size_t period, const StlParams& params, StlWorkspace<T>& workspace);
+
+    /// Returns the seasonal component.
+    const std::vector<T>& seasonal() const {
+        return seasonal_;
     }
 
-    seasonal_ = std::move(seasonal);
-    trend_ = std::move(trend);
-    remainder_ = std::move(remainder);
-    weights_ = std::move(weights);
+    /// Returns the trend component.
+    const std::vector<T>& trend() const {
+        return trend_;
+    }
+
+    /// Returns the remainder.
+    const std::vector<T>& remainder() const {
+        return remainder_;
+    }
+
+    /// Returns the weights.
+    const std::vector<T>& weights() const {
+        return weights_;
+    }
+
+    /// Returns the seasonal strength.
+    double seasonal_strength() const {
+        return detail::strength(seasonal_, remainder_);
+    }
+
+    /// Returns the trend strength.
+    double trend_strength() const {
+        return detail::strength(trend_, remainder_);
+    }
+
+    /// Returns the number of robustness iterations run.
+    size_t outer_loops() const {
+        return outer_loops_;
+    }
+
+  private:
+    void init(std::span<const T> series, size_t period, const StlParams& params, detail::StlWork<T>& work);
+
+    std::vector<T> seasonal_;
+    std::vector<T> trend_;
+    std::vector<T> remainder_;
+    std::vector<T> weights_;
+    size_t outer_loops_ = 0;
+};
+
+template<typename T>
+Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params) {
+    detail::StlWork<T> work;
+    init(series, period, params, work);
 }
 
 template<typename T>
 Stl<T>::Stl(const std::vector<T>& series, size_t period, const StlParams& params) :
     Stl(std::span{series}, period, params) {}
 
+template<typename T>
+Stl<T>::Stl(std::span<const T> series, size_t period, const StlParams& params, StlWorkspace<T>& workspace) {
+    init(series, period, params, workspace.work_);
+}
+
+template<typename T>
+Stl<T>::Stl(const std::vector<T>& series, size_t period, const StlParams& params, StlWorkspace<T>& workspace) :
+    Stl(std::span{series}, period, params, workspace) {}
+
+template<typename T>
+void Stl<T>::init(std::span<const T> series, size_t period, const StlParams& params, detail::StlWork<T>& work) {
+    outer_loops_ = detail::fit(series, period, params, seasonal_, trend_, weights_, work);
+
+    remainder_.reserve(series.size());
+    // TODO use std::views::zip for C++23
+    for (size_t i = 0; i < series.size(); i++) {
+        remainder_.push_back(detail::span_at(series, i) - seasonal_.at(i) - trend_.at(i));
+    }
+}
+
 /// A set of MSTL parameters.
 struct MstlParams {
     /// Sets the number of iterations.
@@ -795,6 +1454,10 @@ std::tuple<std::vector<T>, std::vector<T>, std::vector<std::vector<T>>> mstl(
         ? box_cox(x, lambda.value())
         : std::vector<T>(x.begin(), x.end());
 
+    // the work arrays and weights are reused by each fit
+    StlWork<T> work;
+    std::vector<T> weights;
+
     if (!seas_ids.empty()) {
         for (size_t i = 0; i < seas_ids.size(); i++) {
             seasonality.push_back(std::vector<T>());
@@ -816,10 +1479,7 @@ std::tuple<std::vector<T>, std::vector<T>, std::vector<std::vector<T>>> mstl(
                 } else if (!stl_params.seasonal_length.has_value()) {
                     params.seasonal_length = 7 + 4 * (i + 1);
                 }
-                Stl<T> fit{deseas, span_at(seas_ids, idx), params};
-
-                seasonality.at(idx) = fit.seasonal();
-                trend = fit.trend();
+                fit(std::span<const T>{deseas}, span_at(seas_ids, idx), params, seasonality.at(idx), trend, weights, work);
 
                 for (size_t ii = 0; ii < deseas.size(); ii++) {
                     deseas.at(ii) -= seasonality.at(idx).at(ii);
@@ -2,11 +2,36 @@
 require "anomaly_detection/ext"
 
 # modules
+require_relative "anomaly_detection/decomposition"
+require_relative "anomaly_detection/stream"
 require_relative "anomaly_detection/version"
 
 module AnomalyDetection
   class << self
-    def detect(series, period:, max_anoms: 0.1, alpha: 0.05, direction: "both", plot: false, verbose: false)
+    def detect(series, period:, max_anoms: 0.1, alpha: 0.05, direction: "both", dtype: :float32, threads: 1, stop_after: nil, window_length: nil, robustness_tolerance: nil, interpolate: false, timestamps: nil, stats: nil, details: nil, imputed: nil, plot: false, verbose: false)
+      if stats && !stats.is_a?(Hash)
+        raise ArgumentError, "stats must be a hash"
+      end
+      if details && !details.is_a?(Hash)
+        raise ArgumentError, "details must be a hash"
+      end
+      if imputed && !imputed.is_a?(Array)
+        raise ArgumentError, "imputed must be an array"
+      end
+
+      # sorting and period detection are done natively for timestamps
+      if timestamps
+        if period.is_a?(Array)
+          raise ArgumentError, "period must be an integer for timestamps"
+        end
+
+        # flush Ruby output since std::endl flushes C++ output
+        $stdout.flush if verbose
+
+        period = period == :auto ? 0 : [period || 1, 1].max
+        return _detect_timestamps(timestamps, series, period, max_anoms, alpha, direction, verbose, dtype.to_s, threads || 0, stop_after || 0, window_length, robustness_tolerance, interpolate, stats, details, imputed)
+      end
+
       if period == :auto
         period = determine_period(series)
         puts "Set period to #{period}" if verbose
@@ -14,7 +39,10 @@ module AnomalyDetection
         period = 1
       end
 
-      raise ArgumentError, "series must contain at least 2 periods" if series.size < period * 2
+      # size of packed strings is checked natively
+      if !series.is_a?(String) && series.size < (Array(period).max || 1) * 2
+        raise ArgumentError, "series must contain at least 2 periods"
+      end
 
       if series.is_a?(Hash)
         sorted = series.sort_by { |k, _| k }
@@ -26,11 +54,37 @@ module AnomalyDetection
       # flush Ruby output since std::endl flushes C++ output
       $stdout.flush if verbose
 
-      res = _detect(x, period, max_anoms, alpha, direction, verbose)
-      res.map! { |i| sorted[i][0] } if series.is_a?(Hash)
+      res = _detect(x, Array(period), max_anoms, alpha, direction, verbose, dtype.to_s, threads || 0, stop_after || 0, window_length, robustness_tolerance, interpolate, stats, details, imputed)
+      if series.is_a?(Hash)
+        res.map! { |i| sorted[i][0] }
+        imputed&.map! { |i| sorted[i][0] }
+      end
       res
     end
 
+    # errors for individual series are returned instead of raised
+    def detect_many(series_list, period:, max_anoms: 0.1, alpha: 0.05, direction: "both", dtype: :float32, threads: nil)
+      if period == :auto
+        raise ArgumentError, "period must be an integer for detect_many"
+      elsif period.nil?
+        period = 1
+      end
+
+      sorted_list = series_list.map { |series| series.sort_by { |k, _| k } if series.is_a?(Hash) }
+      x = series_list.zip(sorted_list).map { |series, sorted| sorted ? sorted.map(&:last) : series }
+
+      res = _detect_many(x, period, max_anoms, alpha, direction, threads || 0, dtype.to_s)
+      res.zip(sorted_list).map do |r, sorted|
+        if r.is_a?(String)
+          ArgumentError.new(r)
+        elsif sorted
+          r.map { |i| sorted[i][0] }
+        else
+          r
+        end
+      end
+    end
+
     # TODO add tooltips
     def plot(series, anomalies)
       require "vega"
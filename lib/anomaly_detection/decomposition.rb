@@ -0,0 +1,42 @@
+module AnomalyDetection
+  class Decomposition
+    def initialize(series, period:, dtype: :float32)
+      if period == :auto
+        period = AnomalyDetection.determine_period(series)
+      elsif period.nil?
+        period = 1
+      end
+
+      raise ArgumentError, "series must contain at least 2 periods" if series.size < period * 2
+
+      if series.is_a?(Hash)
+        sorted = series.sort_by { |k, _| k }
+        @keys = sorted.map(&:first)
+        x = sorted.map(&:last)
+      else
+        x = series
+      end
+
+      klass =
+        case dtype.to_s
+        when "float32"
+          FloatDecomposition
+        when "float64"
+          DoubleDecomposition
+        else
+          raise ArgumentError, "dtype must be float32 or float64"
+        end
+
+      @decomposition = klass._new(x, period)
+    end
+
+    def detect(max_anoms: 0.1, alpha: 0.05, direction: "both", verbose: false)
+      # flush Ruby output since std::endl flushes C++ output
+      $stdout.flush if verbose
+
+      res = @decomposition._detect(max_anoms, alpha, direction, verbose)
+      res.map! { |i| @keys[i] } if @keys
+      res
+    end
+  end
+end
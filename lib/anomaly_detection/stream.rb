@@ -0,0 +1,13 @@
+module AnomalyDetection
+  class Stream
+    def initialize(period:, periods: 4, alpha: 0.05, direction: "both", robustness_tolerance: nil)
+      @stream = DoubleStream._new(period || 1, periods, alpha, direction, robustness_tolerance)
+      # refits release the GVL, so adds from other threads wait for them
+      @mutex = Mutex.new
+    end
+
+    def add(value)
+      @mutex.synchronize { @stream._add(value) }
+    end
+  end
+end
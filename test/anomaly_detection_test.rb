@@ -10,6 +10,101 @@ class AnomalyDetectionTest < Minitest::Test
     assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2)
   end
 
+  def test_timestamps
+    start = Time.utc(2020, 1, 1).to_i
+    timestamps = series.size.times.map { |i| start + i * 86400 }
+    expected = [9, 15, 26].map { |i| timestamps[i] }
+    assert_equal expected, AnomalyDetection.detect(series, timestamps: timestamps, period: 7, max_anoms: 0.2)
+    assert_equal expected, AnomalyDetection.detect(series.reverse, timestamps: timestamps.reverse, period: :auto, max_anoms: 0.2)
+  end
+
+  def test_timestamps_size
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series, timestamps: [1, 2, 3], period: 7)
+    end
+    assert_equal "timestamps and series must have the same size", error.message
+  end
+
+  def test_packed_float32
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series.pack("e*"), period: 7, max_anoms: 0.2)
+  end
+
+  def test_packed_float64
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series.pack("E*"), period: 7, max_anoms: 0.2, dtype: :float64)
+  end
+
+  def test_packed_unaligned
+    str = ("\0" + series.pack("e*")).byteslice(1..)
+    assert_equal [9, 15, 26], AnomalyDetection.detect(str, period: 7, max_anoms: 0.2)
+  end
+
+  def test_packed_partial
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series.pack("e*") + "\0", period: 7)
+    end
+    assert_equal "series must contain a whole number of values", error.message
+  end
+
+  def test_dtype_float64
+    series = self.series.map { |v| v + 1e9 }
+    assert_empty AnomalyDetection.detect(series, period: 7, max_anoms: 0.2)
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, dtype: :float64)
+  end
+
+  def test_dtype_bad
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series, period: 7, dtype: :float16)
+    end
+    assert_equal "dtype must be float32 or float64", error.message
+  end
+
+  def test_long_period
+    series = 600.times.map { |i| 10 * Math.sin(2 * Math::PI * (i % 50) / 50) + (i * 7919 % 13) / 4.0 }
+    [97, 283, 452].each { |i| series[i] += 30 }
+    series[333] -= 25
+    assert_equal [97, 283, 333, 452], AnomalyDetection.detect(series, period: 50, max_anoms: 0.05)
+    assert_equal [97, 283, 452], AnomalyDetection.detect(series, period: 50, max_anoms: 0.05, direction: "pos")
+  end
+
+  def test_multiple_periods
+    series = 120.times.map { |i| 15 * Math.sin(2 * Math::PI * (i % 7) / 7) + 20 * Math.sin(2 * Math::PI * (i % 30) / 30) + (i * 7919 % 13) / 4.0 }
+    series[37] += 12
+    series[88] -= 12
+    assert_empty AnomalyDetection.detect(series, period: 7, max_anoms: 0.1)
+    assert_equal [37, 88], AnomalyDetection.detect(series, period: [7, 30], max_anoms: 0.1)
+  end
+
+  def test_window_length
+    series = 600.times.map { |i| 10 * Math.sin(2 * Math::PI * (i % 50) / 50) + (i * 7919 % 13) / 4.0 }
+    [97, 283, 452].each { |i| series[i] += 30 }
+    series[333] -= 25
+    assert_equal [97, 283, 333, 452], AnomalyDetection.detect(series, period: 50, max_anoms: 0.05, window_length: 200)
+    assert_equal [97, 283, 333, 452], AnomalyDetection.detect(series, period: 50, max_anoms: 0.05, window_length: 200, threads: 4)
+  end
+
+  def test_window_length_timestamps
+    series = 600.times.map { |i| 10 * Math.sin(2 * Math::PI * (i % 50) / 50) + (i * 7919 % 13) / 4.0 }
+    [97, 283, 452].each { |i| series[i] += 30 }
+    series[333] -= 25
+    timestamps = series.size.times.map { |i| i * 60 }
+    expected = [97, 283, 333, 452].map { |i| timestamps[i] }
+    assert_equal expected, AnomalyDetection.detect(series, timestamps: timestamps, period: 50, max_anoms: 0.05, window_length: 200)
+  end
+
+  def test_window_length_zero
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series, period: 7, window_length: 0)
+    end
+    assert_equal "window_length must be positive", error.message
+  end
+
+  def test_window_length_short
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series, period: 7, window_length: 13)
+    end
+    assert_equal "window_length must be at least 2 periods", error.message
+  end
+
   def test_no_seasonality
     series = [1.0, 6.0, 2.0, 3.0, 3.0, 0.0]
     assert_equal [1], AnomalyDetection.detect(series, period: 1, max_anoms: 0.2)
@@ -38,6 +133,60 @@ class AnomalyDetectionTest < Minitest::Test
     assert_equal [1, 4, 9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, alpha: 0.5)
   end
 
+  # critical values are cached by alpha and tail
+  def test_alpha_cache
+    2.times do
+      assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2)
+      assert_equal [1, 4, 9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, alpha: 0.5)
+      assert_equal [9, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, direction: "pos")
+    end
+  end
+
+  def test_stop_after
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, stop_after: 1)
+    assert_equal [1, 4, 9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, alpha: 0.5, stop_after: 1)
+  end
+
+  def test_stats
+    stats = {}
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, stats: stats)
+    assert_equal 6, stats[:iterations]
+    assert_operator stats[:decompose_time], :>, 0
+    assert_operator stats[:esd_time], :>, 0
+  end
+
+  def test_robustness_tolerance
+    stats = {}
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, robustness_tolerance: 0.01, stats: stats)
+    assert_equal 8, stats[:outer_loops]
+  end
+
+  def test_robustness_tolerance_negative
+    error = assert_raises(ArgumentError) do
+      AnomalyDetection.detect(series, period: 7, robustness_tolerance: -0.01)
+    end
+    assert_equal "robustness_tolerance must be non-negative", error.message
+  end
+
+  def test_details
+    details = {}
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, details: details)
+    scores = details[:scores].unpack("d*")
+    critical_values = details[:critical_values].unpack("d*")
+    expected_values = details[:expected_values].unpack("d*")
+    residuals = details[:residuals].unpack("d*")
+    assert_equal [6.6545, 4.2989, 7.5825], scores.map { |v| v.round(4) }
+    assert_equal [2.8927, 2.8762, 2.9085], critical_values.map { |v| v.round(4) }
+    assert_equal [2.8587, 4.0536, 7.593], expected_values.map { |v| v.round(4) }
+    assert_equal [18, -5, 30], expected_values.zip(residuals).map { |e, r| (e + r).round(4) }
+  end
+
+  def test_ties
+    series = self.series.map { |v| v == 18 ? 30.0 : v }
+    series[4] = -5.0
+    assert_equal [4, 9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2)
+  end
+
   def test_nan
     series = [1] * 30
     series[15] = Float::NAN
@@ -47,6 +196,26 @@ class AnomalyDetectionTest < Minitest::Test
     assert_equal "series contains NANs", error.message
   end
 
+  def test_interpolate
+    series = self.series.dup
+    series[0] = nil
+    series[3] = Float::NAN
+    series[4] = nil
+    series[20] = nil
+    series[29] = nil
+    imputed = []
+    assert_equal [9, 15, 26], AnomalyDetection.detect(series, period: 7, max_anoms: 0.2, interpolate: true, imputed: imputed)
+    assert_equal [0, 3, 4, 20, 29], imputed
+  end
+
+  def test_interpolate_non_numeric
+    series = self.series.dup
+    series[3] = "a"
+    assert_raises(TypeError) do
+      AnomalyDetection.detect(series, period: 7, interpolate: true)
+    end
+  end
+
   def test_empty_data
     error = assert_raises(ArgumentError) do
       AnomalyDetection.detect([], period: 7)
@@ -65,6 +234,80 @@ class AnomalyDetectionTest < Minitest::Test
     assert_empty AnomalyDetection.detect(series, period: 7, max_anoms: 0)
   end
 
+  def test_detect_threads
+    series = 2000.times.map { |i| Math.sin(i * 2 * Math::PI / 50) + (i % 7) * 0.1 }
+    series[500] = 10
+    expected = AnomalyDetection.detect(series, period: 50)
+    assert_includes expected, 500
+    assert_equal expected, AnomalyDetection.detect(series, period: 50, threads: 4)
+    assert_equal expected, AnomalyDetection.detect(series, period: 50, threads: nil)
+  end
+
+  def test_detect_many
+    series_list = [series, time_series, [1.0] * 5]
+    res = AnomalyDetection.detect_many(series_list, period: 7, max_anoms: 0.2, dtype: :float64, threads: 2)
+    assert_equal [9, 15, 26], res[0]
+    assert_equal [9, 15, 26].map { |i| time_series.keys[0] + i }, res[1]
+    assert_kind_of ArgumentError, res[2]
+    assert_equal "series must contain at least 2 periods", res[2].message
+  end
+
+  def test_decomposition
+    decomposition = AnomalyDetection::Decomposition.new(series, period: 7)
+    assert_equal [9, 15, 26], decomposition.detect(max_anoms: 0.2)
+    assert_equal [9, 26], decomposition.detect(direction: "pos")
+    assert_equal [1, 4, 9, 15, 26], decomposition.detect(max_anoms: 0.2, alpha: 0.5)
+  end
+
+  def test_decomposition_hash
+    decomposition = AnomalyDetection::Decomposition.new(time_series, period: :auto)
+    assert_equal [9, 15, 26].map { |i| time_series.keys[0] + i }, decomposition.detect(max_anoms: 0.2)
+  end
+
+  def test_stream
+    stream = AnomalyDetection::Stream.new(period: 7)
+    assert_equal [15, 26], series.each_index.select { |i| stream.add(series[i]) }
+  end
+
+  def test_stream_robustness_tolerance
+    stream = AnomalyDetection::Stream.new(period: 7, robustness_tolerance: 0.01)
+    assert_equal [15, 26], series.each_index.select { |i| stream.add(series[i]) }
+  end
+
+  def test_stream_threads
+    threads = 4.times.map do
+      Thread.new do
+        stream = AnomalyDetection::Stream.new(period: 7)
+        series.each_index.select { |i| stream.add(series[i]) }
+      end
+    end
+    threads.each do |thread|
+      assert_equal [15, 26], thread.value
+    end
+  end
+
+  def test_stream_direction_pos
+    stream = AnomalyDetection::Stream.new(period: 7, direction: "pos")
+    assert_equal [26], series.each_index.select { |i| stream.add(series[i]) }
+  end
+
+  def test_threads
+    expected = AnomalyDetection.detect(series, period: 7, max_anoms: 0.2)
+    threads = 4.times.map { Thread.new { AnomalyDetection.detect(series, period: 7, max_anoms: 0.2) } }
+    threads.each do |thread|
+      assert_equal expected, thread.value
+    end
+  end
+
+  def test_timeout
+    series = 100000.times.map { |i| Math.sin(i) + i % 7 }
+    assert_raises(Timeout::Error) do
+      Timeout.timeout(0.01) do
+        AnomalyDetection.detect(series, period: 24)
+      end
+    end
+  end
+
   def test_plot_hash
     today = Date.today
     series = self.series.map.with_index.to_h { |v, i| [today + i, v] }
@@ -2,3 +2,4 @@ require "bundler/setup"
 Bundler.require(:default)
 require "minitest/autorun"
 require "date"
+require "timeout"